@@ -32,6 +32,19 @@ except Exception:
 
 sys.stdout.write("\nArchitecture: "  + platform.architecture()[0])
 
+# directories where packages are installed (reticulate caches this
+# configuration until they change)
+try:
+  import sysconfig
+  import site
+  paths = sysconfig.get_paths()
+  site_packages = [paths['purelib'], paths['platlib']]
+  if site.ENABLE_USER_SITE:
+    site_packages.append(site.getusersitepackages())
+  sys.stdout.write('\nSitePackages: ' + os.pathsep.join(sorted(set(site_packages))))
+except Exception:
+  pass
+
 try:
   import numpy
   sys.stdout.write('\nNumpyPath: ' + str(numpy.__path__[0]))
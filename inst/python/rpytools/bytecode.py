@@ -0,0 +1,76 @@
+import marshal
+import os
+import struct
+import sys
+
+# Bytecode for scripts run via py_run_file() is cached in __pycache__ in the
+# same way as it is for imported modules, validated against the modification
+# time and size of the source file. Caching is only supported on Python 3.4+,
+# and bytecode is only written when requested (via the
+# reticulate.write_bytecode option) and not disabled by sys.dont_write_bytecode.
+
+def _cache_path(path):
+  try:
+    from importlib.util import cache_from_source
+    return cache_from_source(path)
+  except (ImportError, NotImplementedError, ValueError):
+    return None
+
+def _header(mtime, size):
+  from importlib.util import MAGIC_NUMBER
+  fields = struct.pack('<II', mtime & 0xFFFFFFFF, size & 0xFFFFFFFF)
+  if sys.version_info >= (3, 7):
+    # timestamp based pyc (flags = 0)
+    return MAGIC_NUMBER + struct.pack('<I', 0) + fields
+  return MAGIC_NUMBER + fields
+
+def load_cached(path, mtime, size):
+
+  cache = _cache_path(path)
+  if cache is None:
+    return None
+
+  try:
+    with open(cache, 'rb') as f:
+      data = f.read()
+  except (IOError, OSError):
+    return None
+
+  header = _header(mtime, size)
+  if not data.startswith(header):
+    return None
+
+  try:
+    return marshal.loads(data[len(header):])
+  except (EOFError, ValueError, TypeError):
+    return None
+
+def compile_source(path, source, mtime, size, write = False):
+
+  code = compile(source, path, 'exec', dont_inherit = True)
+
+  if not write or sys.dont_write_bytecode:
+    return code
+
+  cache = _cache_path(path)
+  if cache is None:
+    return code
+
+  # write to a temporary file and then rename it so that concurrent
+  # readers never see a partially written file
+  temp = '%s.%d.tmp' % (cache, os.getpid())
+  try:
+    directory = os.path.dirname(cache)
+    if not os.path.isdir(directory):
+      os.makedirs(directory)
+    with open(temp, 'wb') as f:
+      f.write(_header(mtime, size))
+      marshal.dump(code, f)
+    os.replace(temp, cache)
+  except (IOError, OSError):
+    try:
+      os.remove(temp)
+    except (IOError, OSError):
+      pass
+
+  return code
@@ -0,0 +1,73 @@
+import mmap
+import os
+import struct
+
+# Objects saved by py_save_object(out_of_band = TRUE) are pickled with
+# protocol 5, with large buffers (e.g. the data of NumPy arrays) written
+# out-of-band as separate segments of the file rather than being copied into
+# the pickle stream. Each segment is aligned so that arrays loaded from a
+# memory map of the file are suitably aligned. The layout is:
+#
+#   magic (8 bytes)
+#   number of buffers n (uint64)
+#   (offset, length) of the pickle stream, then of each buffer (2 x uint64 each)
+#   segments
+#
+# All integers are little endian.
+
+MAGIC = b'RPKLOOB1'
+ALIGNMENT = 64
+
+def _aligned(offset):
+  return (offset + ALIGNMENT - 1) // ALIGNMENT * ALIGNMENT
+
+def dump(obj, filename, pickle):
+
+  if getattr(pickle, 'HIGHEST_PROTOCOL', 0) < 5:
+    raise RuntimeError('out-of-band buffers require pickle protocol 5 (Python >= 3.8)')
+
+  buffers = []
+  stream = pickle.dumps(obj, protocol = 5, buffer_callback = buffers.append)
+  segments = [memoryview(stream)] + [buffer.raw() for buffer in buffers]
+
+  offset = _aligned(len(MAGIC) + 8 + 16 * len(segments))
+  layout = []
+  for segment in segments:
+    layout.append((offset, segment.nbytes))
+    offset = _aligned(offset + segment.nbytes)
+
+  with open(filename, 'wb') as f:
+    f.write(MAGIC)
+    f.write(struct.pack('<Q', len(buffers)))
+    for entry in layout:
+      f.write(struct.pack('<QQ', *entry))
+    for (offset, length), segment in zip(layout, segments):
+      f.seek(offset)
+      f.write(segment)
+    f.truncate(_aligned(f.tell()))
+
+def load(filename, pickle, use_mmap = True):
+
+  with open(filename, 'rb') as f:
+
+    # files without out-of-band buffers are ordinary pickles
+    if f.read(len(MAGIC)) != MAGIC:
+      f.seek(0)
+      return pickle.load(f)
+
+    (count,) = struct.unpack('<Q', f.read(8))
+    layout = [struct.unpack('<QQ', f.read(16)) for i in range(count + 1)]
+
+    # buffers are views into the file mapped copy-on-write (so that the
+    # arrays referring to them are writable, without changing the file), or
+    # into a copy of the file read into memory
+    if use_mmap:
+      data = mmap.mmap(f.fileno(), 0, access = mmap.ACCESS_COPY)
+    else:
+      data = bytearray(os.fstat(f.fileno()).st_size)
+      f.seek(0)
+      f.readinto(data)
+
+  view = memoryview(data)
+  segments = [view[offset:offset + length] for offset, length in layout]
+  return pickle.loads(segments[0], buffers = segments[1:])
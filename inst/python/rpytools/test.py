@@ -54,6 +54,18 @@ def invokeOnThread(f, *args, **kwargs):
     thread.join(0.1)
   return result[0]
 
+def invokeOnThreads(f, n):
+  results = [None] * n
+  def invoke_worker(i):
+    results[i] = f(i)
+  threads = [threading.Thread(target = invoke_worker, args = (i,)) for i in range(n)]
+  for thread in threads:
+    thread.start()
+  for thread in threads:
+    while thread.is_alive():
+      thread.join(0.1)
+  return results
+
 
 def reflect(x):
   return x
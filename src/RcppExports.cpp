@@ -38,6 +38,15 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// py_class_cache_clear
+void py_class_cache_clear();
+RcppExport SEXP _reticulate_py_class_cache_clear() {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    py_class_cache_clear();
+    return R_NilValue;
+END_RCPP
+}
 // py_last_error
 SEXP py_last_error();
 RcppExport SEXP _reticulate_py_last_error() {
@@ -80,6 +89,52 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// r_convert_dataframe
+PyObjectRef r_convert_dataframe(RObject dataframe, bool convert);
+RcppExport SEXP _reticulate_r_convert_dataframe(SEXP dataframeSEXP, SEXP convertSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< RObject >::type dataframe(dataframeSEXP);
+    Rcpp::traits::input_parameter< bool >::type convert(convertSEXP);
+    rcpp_result_gen = Rcpp::wrap(r_convert_dataframe(dataframe, convert));
+    return rcpp_result_gen;
+END_RCPP
+}
+// py_convert_pandas_df
+List py_convert_pandas_df(PyObjectRef df);
+RcppExport SEXP _reticulate_py_convert_pandas_df(SEXP dfSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< PyObjectRef >::type df(dfSEXP);
+    rcpp_result_gen = Rcpp::wrap(py_convert_pandas_df(df));
+    return rcpp_result_gen;
+END_RCPP
+}
+// py_arrow_to_r_impl
+SEXP py_arrow_to_r_impl(PyObjectRef x);
+RcppExport SEXP _reticulate_py_arrow_to_r_impl(SEXP xSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< PyObjectRef >::type x(xSEXP);
+    rcpp_result_gen = Rcpp::wrap(py_arrow_to_r_impl(x));
+    return rcpp_result_gen;
+END_RCPP
+}
+// r_to_py_arrow_impl
+PyObjectRef r_to_py_arrow_impl(RObject x, bool convert);
+RcppExport SEXP _reticulate_r_to_py_arrow_impl(SEXP xSEXP, SEXP convertSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< RObject >::type x(xSEXP);
+    Rcpp::traits::input_parameter< bool >::type convert(convertSEXP);
+    rcpp_result_gen = Rcpp::wrap(r_to_py_arrow_impl(x, convert));
+    return rcpp_result_gen;
+END_RCPP
+}
 // py_activate_virtualenv
 void py_activate_virtualenv(const std::string& script);
 RcppExport SEXP _reticulate_py_activate_virtualenv(SEXP scriptSEXP) {
@@ -250,6 +305,31 @@ BEGIN_RCPP
     return R_NilValue;
 END_RCPP
 }
+// py_get_attr_cached
+SEXP py_get_attr_cached(PyObjectRef x, const std::string& name);
+RcppExport SEXP _reticulate_py_get_attr_cached(SEXP xSEXP, SEXP nameSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< PyObjectRef >::type x(xSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type name(nameSEXP);
+    rcpp_result_gen = Rcpp::wrap(py_get_attr_cached(x, name));
+    return rcpp_result_gen;
+END_RCPP
+}
+// py_attr_cache_store
+void py_attr_cache_store(PyObjectRef x, const std::string& name, PyObjectRef attr, RObject wrapper);
+RcppExport SEXP _reticulate_py_attr_cache_store(SEXP xSEXP, SEXP nameSEXP, SEXP attrSEXP, SEXP wrapperSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< PyObjectRef >::type x(xSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type name(nameSEXP);
+    Rcpp::traits::input_parameter< PyObjectRef >::type attr(attrSEXP);
+    Rcpp::traits::input_parameter< RObject >::type wrapper(wrapperSEXP);
+    py_attr_cache_store(x, name, attr, wrapper);
+    return R_NilValue;
+END_RCPP
+}
 // py_get_attribute_types
 IntegerVector py_get_attribute_types(PyObjectRef x, const std::vector<std::string>& attributes);
 RcppExport SEXP _reticulate_py_get_attribute_types(SEXP xSEXP, SEXP attributesSEXP) {
@@ -285,6 +365,39 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// py_numpy_vector_impl
+PyObjectRef py_numpy_vector_impl(RObject x);
+RcppExport SEXP _reticulate_py_numpy_vector_impl(SEXP xSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< RObject >::type x(xSEXP);
+    rcpp_result_gen = Rcpp::wrap(py_numpy_vector_impl(x));
+    return rcpp_result_gen;
+END_RCPP
+}
+// py_numpy_vector_to_r_impl
+SEXP py_numpy_vector_to_r_impl(PyObjectRef x);
+RcppExport SEXP _reticulate_py_numpy_vector_to_r_impl(SEXP xSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< PyObjectRef >::type x(xSEXP);
+    rcpp_result_gen = Rcpp::wrap(py_numpy_vector_to_r_impl(x));
+    return rcpp_result_gen;
+END_RCPP
+}
+// py_buffer_view_impl
+SEXP py_buffer_view_impl(PyObjectRef x);
+RcppExport SEXP _reticulate_py_buffer_view_impl(SEXP xSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< PyObjectRef >::type x(xSEXP);
+    rcpp_result_gen = Rcpp::wrap(py_buffer_view_impl(x));
+    return rcpp_result_gen;
+END_RCPP
+}
 // py_call_impl
 SEXP py_call_impl(PyObjectRef x, List args, List keywords);
 RcppExport SEXP _reticulate_py_call_impl(SEXP xSEXP, SEXP argsSEXP, SEXP keywordsSEXP) {
@@ -425,6 +538,19 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// py_iterate_chunked
+List py_iterate_chunked(PyObjectRef x, Function f, int chunk_size);
+RcppExport SEXP _reticulate_py_iterate_chunked(SEXP xSEXP, SEXP fSEXP, SEXP chunk_sizeSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< PyObjectRef >::type x(xSEXP);
+    Rcpp::traits::input_parameter< Function >::type f(fSEXP);
+    Rcpp::traits::input_parameter< int >::type chunk_size(chunk_sizeSEXP);
+    rcpp_result_gen = Rcpp::wrap(py_iterate_chunked(x, f, chunk_size));
+    return rcpp_result_gen;
+END_RCPP
+}
 // py_iter_next
 SEXP py_iter_next(PyObjectRef iterator, RObject completed);
 RcppExport SEXP _reticulate_py_iter_next(SEXP iteratorSEXP, SEXP completedSEXP) {
@@ -475,6 +601,64 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// py_profile_start_impl
+void py_profile_start_impl(int interval_ms, int max_samples);
+RcppExport SEXP _reticulate_py_profile_start_impl(SEXP interval_msSEXP, SEXP max_samplesSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< int >::type interval_ms(interval_msSEXP);
+    Rcpp::traits::input_parameter< int >::type max_samples(max_samplesSEXP);
+    py_profile_start_impl(interval_ms, max_samples);
+    return R_NilValue;
+END_RCPP
+}
+// py_profile_stop_impl
+List py_profile_stop_impl();
+RcppExport SEXP _reticulate_py_profile_stop_impl() {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    rcpp_result_gen = Rcpp::wrap(py_profile_stop_impl());
+    return rcpp_result_gen;
+END_RCPP
+}
+// py_stats_impl
+List py_stats_impl(bool reset);
+RcppExport SEXP _reticulate_py_stats_impl(SEXP resetSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< bool >::type reset(resetSEXP);
+    rcpp_result_gen = Rcpp::wrap(py_stats_impl(reset));
+    return rcpp_result_gen;
+END_RCPP
+}
+// py_compile_impl
+PyObjectRef py_compile_impl(const std::string& code, bool eval);
+RcppExport SEXP _reticulate_py_compile_impl(SEXP codeSEXP, SEXP evalSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string& >::type code(codeSEXP);
+    Rcpp::traits::input_parameter< bool >::type eval(evalSEXP);
+    rcpp_result_gen = Rcpp::wrap(py_compile_impl(code, eval));
+    return rcpp_result_gen;
+END_RCPP
+}
+// py_eval_code_impl
+SEXP py_eval_code_impl(PyObjectRef code, RObject globals, RObject locals, bool convert);
+RcppExport SEXP _reticulate_py_eval_code_impl(SEXP codeSEXP, SEXP globalsSEXP, SEXP localsSEXP, SEXP convertSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< PyObjectRef >::type code(codeSEXP);
+    Rcpp::traits::input_parameter< RObject >::type globals(globalsSEXP);
+    Rcpp::traits::input_parameter< RObject >::type locals(localsSEXP);
+    Rcpp::traits::input_parameter< bool >::type convert(convertSEXP);
+    rcpp_result_gen = Rcpp::wrap(py_eval_code_impl(code, globals, locals, convert));
+    return rcpp_result_gen;
+END_RCPP
+}
 // readline
 SEXP readline(const std::string& prompt);
 RcppExport SEXP _reticulate_readline(SEXP promptSEXP) {
@@ -491,10 +675,15 @@ static const R_CallMethodDef CallEntries[] = {
     {"_reticulate_write_stdout", (DL_FUNC) &_reticulate_write_stdout, 1},
     {"_reticulate_write_stderr", (DL_FUNC) &_reticulate_write_stderr, 1},
     {"_reticulate_is_python3", (DL_FUNC) &_reticulate_is_python3, 0},
+    {"_reticulate_py_class_cache_clear", (DL_FUNC) &_reticulate_py_class_cache_clear, 0},
     {"_reticulate_py_last_error", (DL_FUNC) &_reticulate_py_last_error, 0},
     {"_reticulate_py_clear_last_error", (DL_FUNC) &_reticulate_py_clear_last_error, 0},
     {"_reticulate_py_is_callable", (DL_FUNC) &_reticulate_py_is_callable, 1},
     {"_reticulate_r_to_py_impl", (DL_FUNC) &_reticulate_r_to_py_impl, 2},
+    {"_reticulate_r_convert_dataframe", (DL_FUNC) &_reticulate_r_convert_dataframe, 2},
+    {"_reticulate_py_convert_pandas_df", (DL_FUNC) &_reticulate_py_convert_pandas_df, 1},
+    {"_reticulate_py_arrow_to_r_impl", (DL_FUNC) &_reticulate_py_arrow_to_r_impl, 1},
+    {"_reticulate_r_to_py_arrow_impl", (DL_FUNC) &_reticulate_r_to_py_arrow_impl, 2},
     {"_reticulate_py_activate_virtualenv", (DL_FUNC) &_reticulate_py_activate_virtualenv, 1},
     {"_reticulate_py_initialize", (DL_FUNC) &_reticulate_py_initialize, 7},
     {"_reticulate_py_finalize", (DL_FUNC) &_reticulate_py_finalize, 0},
@@ -510,9 +699,14 @@ static const R_CallMethodDef CallEntries[] = {
     {"_reticulate_py_has_attr_impl", (DL_FUNC) &_reticulate_py_has_attr_impl, 2},
     {"_reticulate_py_get_attr_impl", (DL_FUNC) &_reticulate_py_get_attr_impl, 3},
     {"_reticulate_py_set_attr_impl", (DL_FUNC) &_reticulate_py_set_attr_impl, 3},
+    {"_reticulate_py_get_attr_cached", (DL_FUNC) &_reticulate_py_get_attr_cached, 2},
+    {"_reticulate_py_attr_cache_store", (DL_FUNC) &_reticulate_py_attr_cache_store, 4},
     {"_reticulate_py_get_attribute_types", (DL_FUNC) &_reticulate_py_get_attribute_types, 2},
     {"_reticulate_py_ref_to_r_with_convert", (DL_FUNC) &_reticulate_py_ref_to_r_with_convert, 2},
     {"_reticulate_py_ref_to_r", (DL_FUNC) &_reticulate_py_ref_to_r, 1},
+    {"_reticulate_py_numpy_vector_impl", (DL_FUNC) &_reticulate_py_numpy_vector_impl, 1},
+    {"_reticulate_py_numpy_vector_to_r_impl", (DL_FUNC) &_reticulate_py_numpy_vector_to_r_impl, 1},
+    {"_reticulate_py_buffer_view_impl", (DL_FUNC) &_reticulate_py_buffer_view_impl, 1},
     {"_reticulate_py_call_impl", (DL_FUNC) &_reticulate_py_call_impl, 3},
     {"_reticulate_py_dict_impl", (DL_FUNC) &_reticulate_py_dict_impl, 3},
     {"_reticulate_py_dict_get_item", (DL_FUNC) &_reticulate_py_dict_get_item, 2},
@@ -525,15 +719,23 @@ static const R_CallMethodDef CallEntries[] = {
     {"_reticulate_py_module_proxy_import", (DL_FUNC) &_reticulate_py_module_proxy_import, 1},
     {"_reticulate_py_list_submodules", (DL_FUNC) &_reticulate_py_list_submodules, 1},
     {"_reticulate_py_iterate", (DL_FUNC) &_reticulate_py_iterate, 2},
+    {"_reticulate_py_iterate_chunked", (DL_FUNC) &_reticulate_py_iterate_chunked, 3},
     {"_reticulate_py_iter_next", (DL_FUNC) &_reticulate_py_iter_next, 2},
     {"_reticulate_py_run_string_impl", (DL_FUNC) &_reticulate_py_run_string_impl, 3},
     {"_reticulate_py_run_file_impl", (DL_FUNC) &_reticulate_py_run_file_impl, 3},
     {"_reticulate_py_eval_impl", (DL_FUNC) &_reticulate_py_eval_impl, 2},
+    {"_reticulate_py_profile_start_impl", (DL_FUNC) &_reticulate_py_profile_start_impl, 2},
+    {"_reticulate_py_profile_stop_impl", (DL_FUNC) &_reticulate_py_profile_stop_impl, 0},
+    {"_reticulate_py_stats_impl", (DL_FUNC) &_reticulate_py_stats_impl, 1},
+    {"_reticulate_py_compile_impl", (DL_FUNC) &_reticulate_py_compile_impl, 2},
+    {"_reticulate_py_eval_code_impl", (DL_FUNC) &_reticulate_py_eval_code_impl, 4},
     {"_reticulate_readline", (DL_FUNC) &_reticulate_readline, 1},
     {NULL, NULL, 0}
 };
 
+void reticulate_init_altrep(DllInfo* dll);
 RcppExport void R_init_reticulate(DllInfo *dll) {
     R_registerRoutines(dll, NULL, CallEntries, NULL, NULL);
     R_useDynamicSymbols(dll, FALSE);
+    reticulate_init_altrep(dll);
 }
@@ -0,0 +1,357 @@
+
+// This code implements ALTREP wrappers which allow R vectors to borrow
+// memory owned by Python objects (e.g. the data buffer of a NumPy array, or
+// any other object exposing the buffer protocol) rather than copying it.
+//
+// The wrapped vector keeps a reference to the owning Python object (or to a
+// capsule holding the exported buffer) in an external pointer (data1), so the
+// memory stays valid for as long as the R vector is reachable. The memory is
+// treated as read-only: if R asks for a writeable pointer (e.g. via REAL()
+// or INTEGER()) we materialize a private copy of the data (data2) and use
+// that copy for all subsequent access, so that R's copy-on-modify semantics
+// are never violated on the Python side.
+
+#include "altrep.h"
+
+#include <Rcpp.h>
+
+#ifdef RETICULATE_HAS_ALTREP
+# if R_VERSION < R_Version(3, 6, 0)
+// R 3.5 uses 'class' as a parameter name in Altrep.h
+#  define class klass
+extern "C" {
+#  include <R_ext/Altrep.h>
+}
+#  undef class
+# else
+#  include <R_ext/Altrep.h>
+# endif
+#endif
+
+#include <cstring>
+
+using namespace libpython;
+
+namespace altrep {
+
+#ifdef RETICULATE_HAS_ALTREP
+
+namespace {
+
+// memory owned by a Python object which we are viewing from R (the owner is
+// either the object itself or a capsule holding the exported buffer)
+struct PythonMemory {
+  PyObject* owner;
+  void* data;
+  R_xlen_t length;
+};
+
+// (run by the garbage collector, so the reference to the owner is released
+// later, in a batch with others; see decref_deferred)
+void python_memory_finalize(SEXP xptr) {
+  PythonMemory* memory = (PythonMemory*) R_ExternalPtrAddr(xptr);
+  if (memory == NULL)
+    return;
+  if (memory->owner != NULL && Py_IsInitialized != NULL && Py_IsInitialized())
+    decref_deferred(memory->owner);
+  delete memory;
+  R_ClearExternalPtr(xptr);
+}
+
+// release an exported buffer once the capsule holding it is freed
+// (releasing the buffer also releases its reference to the exporter)
+void python_buffer_capsule_free(PyObject* capsule) {
+  Py_buffer* buffer = (Py_buffer*) PyCapsule_GetPointer(capsule, NULL);
+  PyBuffer_Release(buffer);
+  delete buffer;
+}
+
+R_altrep_class_t s_real_class;
+R_altrep_class_t s_integer_class;
+R_altrep_class_t s_raw_class;
+bool s_initialized = false;
+
+inline PythonMemory* memory(SEXP x) {
+  return (PythonMemory*) R_ExternalPtrAddr(R_altrep_data1(x));
+}
+
+inline bool is_materialized(SEXP x) {
+  return R_altrep_data2(x) != R_NilValue;
+}
+
+inline size_t element_size(SEXP x) {
+  switch (TYPEOF(x)) {
+  case REALSXP: return sizeof(double);
+  case INTSXP:  return sizeof(int);
+  default:      return sizeof(Rbyte);
+  }
+}
+
+// copy the viewed memory into a standard R vector
+SEXP materialize(SEXP x) {
+
+  SEXP data2 = R_altrep_data2(x);
+  if (data2 != R_NilValue)
+    return data2;
+
+  PythonMemory* mem = memory(x);
+  data2 = PROTECT(Rf_allocVector(TYPEOF(x), mem->length));
+  std::memcpy(DATAPTR(data2), mem->data, mem->length * element_size(x));
+  R_set_altrep_data2(x, data2);
+  UNPROTECT(1);
+
+  return data2;
+}
+
+R_xlen_t python_memory_length(SEXP x) {
+  return memory(x)->length;
+}
+
+Rboolean python_memory_inspect(SEXP x, int pre, int deep, int pvec,
+                               void (*inspect_subtree)(SEXP, int, int, int)) {
+  Rprintf("reticulate::python_memory (len=%d, materialized=%s)\n",
+          (int) python_memory_length(x),
+          is_materialized(x) ? "T" : "F");
+  return TRUE;
+}
+
+SEXP python_memory_serialized_state(SEXP x) {
+  // serialize as a standard (materialized) R vector
+  return materialize(x);
+}
+
+SEXP python_memory_unserialize(SEXP klass, SEXP state) {
+  return state;
+}
+
+void* python_memory_dataptr(SEXP x, Rboolean writeable) {
+  if (writeable || is_materialized(x))
+    return DATAPTR(materialize(x));
+  else
+    return memory(x)->data;
+}
+
+const void* python_memory_dataptr_or_null(SEXP x) {
+  if (is_materialized(x))
+    return DATAPTR_OR_NULL(R_altrep_data2(x));
+  else
+    return memory(x)->data;
+}
+
+double python_memory_real_elt(SEXP x, R_xlen_t i) {
+  return ((const double*) python_memory_dataptr_or_null(x))[i];
+}
+
+int python_memory_integer_elt(SEXP x, R_xlen_t i) {
+  return ((const int*) python_memory_dataptr_or_null(x))[i];
+}
+
+Rbyte python_memory_raw_elt(SEXP x, R_xlen_t i) {
+  return ((const Rbyte*) python_memory_dataptr_or_null(x))[i];
+}
+
+template <typename T>
+R_xlen_t python_memory_get_region(SEXP x, R_xlen_t i, R_xlen_t n, T* buf) {
+  R_xlen_t length = python_memory_length(x);
+  R_xlen_t count = (length - i) < n ? (length - i) : n;
+  if (count > 0) {
+    const T* data = (const T*) python_memory_dataptr_or_null(x);
+    std::memcpy(buf, data + i, count * sizeof(T));
+  }
+  return count;
+}
+
+void register_common_methods(R_altrep_class_t klass) {
+  R_set_altrep_Length_method(klass, python_memory_length);
+  R_set_altrep_Inspect_method(klass, python_memory_inspect);
+  R_set_altrep_Serialized_state_method(klass, python_memory_serialized_state);
+  R_set_altrep_Unserialize_method(klass, python_memory_unserialize);
+  R_set_altvec_Dataptr_method(klass, python_memory_dataptr);
+  R_set_altvec_Dataptr_or_null_method(klass, python_memory_dataptr_or_null);
+}
+
+bool is_little_endian() {
+  int value = 1;
+  return *((char*) &value) == 1;
+}
+
+// determine the R vector type which can view the elements of a buffer
+// (described by a struct module style format string), or NILSXP if the
+// elements can't be represented in R without conversion
+SEXPTYPE buffer_type(const Py_buffer* buffer) {
+
+  // buffers which don't report a format are unsigned bytes
+  const char* format = buffer->format != NULL ? buffer->format : "B";
+
+  // handle byte order prefix
+  switch (*format) {
+  case '@': case '=':
+    format++;
+    break;
+  case '<':
+    if (!is_little_endian())
+      return NILSXP;
+    format++;
+    break;
+  case '>': case '!':
+    if (is_little_endian())
+      return NILSXP;
+    format++;
+    break;
+  }
+
+  // we only handle buffers of a single primitive type
+  if (format[0] == '\0' || format[1] != '\0')
+    return NILSXP;
+
+  switch (format[0]) {
+  case 'd':
+    return buffer->itemsize == sizeof(double) ? REALSXP : NILSXP;
+  case 'i': case 'l':
+    return buffer->itemsize == sizeof(int) ? INTSXP : NILSXP;
+  case 'B': case 'c':
+    return buffer->itemsize == 1 ? RAWSXP : NILSXP;
+  default:
+    return NILSXP;
+  }
+}
+
+SEXP new_python_memory(SEXPTYPE type,
+                       PyObject* owner,
+                       void* data,
+                       R_xlen_t length) {
+
+  R_altrep_class_t klass;
+  if (type == REALSXP)
+    klass = s_real_class;
+  else if (type == INTSXP)
+    klass = s_integer_class;
+  else
+    klass = s_raw_class;
+
+  // create the external pointer which keeps the memory alive
+  PythonMemory* mem = new PythonMemory();
+  mem->owner = owner;
+  mem->data = data;
+  mem->length = length;
+  SEXP xptr = PROTECT(R_MakeExternalPtr(mem, R_NilValue, R_NilValue));
+  R_RegisterCFinalizer(xptr, python_memory_finalize);
+
+  SEXP result = R_new_altrep(klass, xptr, R_NilValue);
+  UNPROTECT(1);
+  return result;
+}
+
+} // anonymous namespace
+
+void initialize(DllInfo* dll) {
+
+  s_real_class = R_make_altreal_class("python_memory_real", "reticulate", dll);
+  register_common_methods(s_real_class);
+  R_set_altreal_Elt_method(s_real_class, python_memory_real_elt);
+  R_set_altreal_Get_region_method(s_real_class, python_memory_get_region<double>);
+
+  s_integer_class = R_make_altinteger_class("python_memory_integer", "reticulate", dll);
+  register_common_methods(s_integer_class);
+  R_set_altinteger_Elt_method(s_integer_class, python_memory_integer_elt);
+  R_set_altinteger_Get_region_method(s_integer_class, python_memory_get_region<int>);
+
+  s_raw_class = R_make_altraw_class("python_memory_raw", "reticulate", dll);
+  register_common_methods(s_raw_class);
+  R_set_altraw_Elt_method(s_raw_class, python_memory_raw_elt);
+  R_set_altraw_Get_region_method(s_raw_class, python_memory_get_region<Rbyte>);
+
+  s_initialized = true;
+}
+
+bool available() {
+  return s_initialized;
+}
+
+SEXP wrap_python_memory(PyObject* owner,
+                        void* data,
+                        R_xlen_t length,
+                        SEXPTYPE type) {
+
+  if (!available())
+    return R_NilValue;
+
+  if (type != REALSXP && type != INTSXP && type != RAWSXP)
+    return R_NilValue;
+
+  Py_IncRef(owner);
+  return new_python_memory(type, owner, data, length);
+}
+
+SEXP wrap_python_buffer(PyObject* object) {
+
+  if (!available())
+    return R_NilValue;
+
+  // request a (column-major) contiguous buffer along with its format
+  Py_buffer* buffer = new Py_buffer();
+  if (PyObject_GetBuffer(object, buffer, PyBUF_FORMAT | PyBUF_F_CONTIGUOUS) != 0) {
+    PyErr_Clear();
+    delete buffer;
+    return R_NilValue;
+  }
+
+  SEXPTYPE type = buffer_type(buffer);
+  if (type == NILSXP || buffer->itemsize <= 0) {
+    PyBuffer_Release(buffer);
+    delete buffer;
+    return R_NilValue;
+  }
+
+  PyObject* capsule = PyCapsule_New(buffer, NULL, python_buffer_capsule_free);
+  if (capsule == NULL) {
+    PyErr_Clear();
+    PyBuffer_Release(buffer);
+    delete buffer;
+    return R_NilValue;
+  }
+
+  R_xlen_t length = buffer->len / buffer->itemsize;
+  SEXP result = PROTECT(new_python_memory(type, capsule, buffer->buf, length));
+
+  // multi-dimensional buffers become arrays
+  if (buffer->ndim > 1 && buffer->shape != NULL) {
+    SEXP dim = PROTECT(Rf_allocVector(INTSXP, buffer->ndim));
+    for (int i = 0; i < buffer->ndim; i++)
+      INTEGER(dim)[i] = (int) buffer->shape[i];
+    Rf_setAttrib(result, R_DimSymbol, dim);
+    UNPROTECT(1);
+  }
+
+  UNPROTECT(1);
+  return result;
+}
+
+#else
+
+void initialize(DllInfo* dll) {}
+
+bool available() {
+  return false;
+}
+
+SEXP wrap_python_memory(PyObject* owner,
+                        void* data,
+                        R_xlen_t length,
+                        SEXPTYPE type) {
+  return R_NilValue;
+}
+
+SEXP wrap_python_buffer(PyObject* object) {
+  return R_NilValue;
+}
+
+#endif // RETICULATE_HAS_ALTREP
+
+} // namespace altrep
+
+// register ALTREP classes when the package is loaded
+// [[Rcpp::init]]
+void reticulate_init_altrep(DllInfo* dll) {
+  altrep::initialize(dll);
+}
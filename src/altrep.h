@@ -0,0 +1,38 @@
+
+#ifndef __RETICULATE_ALTREP__
+#define __RETICULATE_ALTREP__
+
+#include "libpython.h"
+
+#include <Rinternals.h>
+#include <Rversion.h>
+
+// ALTREP is available for R >= 3.5.0
+#if defined(R_VERSION) && R_VERSION >= R_Version(3, 5, 0)
+# define RETICULATE_HAS_ALTREP 1
+#endif
+
+namespace altrep {
+
+// check whether ALTREP wrappers are available in this build
+bool available();
+
+// wrap a block of memory owned by a Python object as an R vector (of type
+// REALSXP, INTSXP or RAWSXP) without copying it. the Python object is kept alive
+// (we take our own reference to 'owner') for as long as the R vector lives.
+// returns R_NilValue if ALTREP is not available.
+SEXP wrap_python_memory(libpython::PyObject* owner,
+                        void* data,
+                        R_xlen_t length,
+                        SEXPTYPE type);
+
+// wrap the memory exported by an object supporting the buffer protocol
+// (e.g. bytes, bytearray, memoryview, NumPy arrays or Arrow buffers) as an
+// R vector without copying it. buffers of doubles, 32-bit integers and bytes
+// are supported; returns R_NilValue if the object doesn't export a compatible
+// contiguous buffer or if ALTREP is not available.
+SEXP wrap_python_buffer(libpython::PyObject* object);
+
+} // namespace altrep
+
+#endif // __RETICULATE_ALTREP__
@@ -0,0 +1,700 @@
+
+// This code implements conversion between R data frames and Arrow record
+// batches using the Arrow C Data Interface. No Arrow libraries are required:
+// the record batches are exchanged (e.g. with pyarrow) as plain C structs.
+//
+// On import we copy the Arrow buffers into R vectors (a single memcpy for
+// columns of doubles and 32-bit integers without nulls). On export, columns
+// of doubles and integers reference the memory of the R vector directly and
+// the vector is preserved until the consumer releases the array; other
+// column types are converted into buffers owned by the exported array.
+
+#include "arrow.h"
+
+#include <Rcpp.h>
+
+#include "tinythread.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+
+namespace arrow {
+
+namespace {
+
+// Import ---------------------------------------------------------------------
+
+inline bool bit_is_set(const void* bitmap, int64_t i) {
+  return (((const uint8_t*) bitmap)[i >> 3] >> (i & 7)) & 1;
+}
+
+inline bool is_valid(const ArrowArray* array, int64_t i) {
+  if (array->null_count == 0 || array->buffers[0] == NULL)
+    return true;
+  return bit_is_set(array->buffers[0], array->offset + i);
+}
+
+template <typename T>
+const T* array_values(const ArrowArray* array, int buffer = 1) {
+  return ((const T*) array->buffers[buffer]) + array->offset;
+}
+
+template <typename T>
+void import_integers(const ArrowArray* array, int* pData) {
+  const T* values = array_values<T>(array);
+  if (sizeof(T) == sizeof(int) && array->null_count == 0) {
+    std::memcpy(pData, values, array->length * sizeof(int));
+    return;
+  }
+  for (int64_t i = 0; i < array->length; i++)
+    pData[i] = is_valid(array, i) ? (int) values[i] : NA_INTEGER;
+}
+
+template <typename T>
+void import_doubles(const ArrowArray* array, double* pData, double scale = 1.0) {
+  const T* values = array_values<T>(array);
+  if (sizeof(T) == sizeof(double) && scale == 1.0 && array->null_count == 0) {
+    std::memcpy(pData, values, array->length * sizeof(double));
+    return;
+  }
+  for (int64_t i = 0; i < array->length; i++)
+    pData[i] = is_valid(array, i) ? values[i] * scale : NA_REAL;
+}
+
+void import_logicals(const ArrowArray* array, int* pData) {
+  const void* bitmap = array->buffers[1];
+  for (int64_t i = 0; i < array->length; i++) {
+    if (is_valid(array, i))
+      pData[i] = bit_is_set(bitmap, array->offset + i);
+    else
+      pData[i] = NA_LOGICAL;
+  }
+}
+
+template <typename T>
+void import_strings(const ArrowArray* array, SEXP x, R_xlen_t start) {
+  const T* offsets = array_values<T>(array);
+  const char* data = (const char*) array->buffers[2];
+  for (int64_t i = 0; i < array->length; i++) {
+    if (is_valid(array, i)) {
+      const char* value = data + offsets[i];
+      int size = (int) (offsets[i + 1] - offsets[i]);
+      SET_STRING_ELT(x, start + i, Rf_mkCharLenCE(value, size, CE_UTF8));
+    } else {
+      SET_STRING_ELT(x, start + i, NA_STRING);
+    }
+  }
+}
+
+// type of R vector used for an Arrow format string
+SEXPTYPE import_type(const std::string& format) {
+  if (format == "b")
+    return LGLSXP;
+  else if (format == "c" || format == "C" || format == "s" ||
+           format == "S" || format == "i")
+    return INTSXP;
+  else if (format == "I" || format == "l" || format == "L" ||
+           format == "f" || format == "g" ||
+           format == "tdD" || format == "tdm" ||
+           format.compare(0, 2, "ts") == 0)
+    return REALSXP;
+  else if (format == "u" || format == "U")
+    return STRSXP;
+  else
+    Rcpp::stop("Unsupported Arrow type '" + format + "'");
+}
+
+// seconds per unit for Arrow timestamp format strings
+double timestamp_scale(const std::string& format) {
+  switch (format[2]) {
+  case 's': return 1;
+  case 'm': return 1E-3;
+  case 'u': return 1E-6;
+  case 'n': return 1E-9;
+  default:
+    Rcpp::stop("Unsupported Arrow type '" + format + "'");
+  }
+}
+
+// convert dictionary index values (we treat negative indices as missing)
+template <typename T>
+void import_indices(const ArrowArray* array,
+                    const std::vector<int>& levels,
+                    int* pData) {
+  const T* values = array_values<T>(array);
+  for (int64_t i = 0; i < array->length; i++) {
+    int64_t index = (int64_t) values[i];
+    if (!is_valid(array, i) || index < 0 || index >= (int64_t) levels.size())
+      pData[i] = NA_INTEGER;
+    else
+      pData[i] = levels[index];
+  }
+}
+
+SEXP import_column(const ArrowSchema* schema,
+                   const std::vector<const ArrowArray*>& chunks,
+                   R_xlen_t length);
+
+// import a dictionary encoded column as a factor
+SEXP import_factor(const ArrowSchema* schema,
+                   const std::vector<const ArrowArray*>& chunks,
+                   R_xlen_t length) {
+
+  std::string format(schema->format);
+  if (import_type(format) != INTSXP && format != "l")
+    Rcpp::stop("Unsupported Arrow dictionary index type '" + format + "'");
+
+  SEXP factor = PROTECT(Rf_allocVector(INTSXP, length));
+  int* pData = INTEGER(factor);
+
+  // chunks can have different dictionaries, so we map the values in each
+  // dictionary to the (1-based) levels of the factor
+  std::vector<std::string> levels;
+  std::map<std::string, int> levelIndex;
+
+  for (std::size_t i = 0; i < chunks.size(); i++) {
+
+    const ArrowArray* chunk = chunks[i];
+    std::vector<const ArrowArray*> dictionary(1, chunk->dictionary);
+    SEXP values = PROTECT(import_column(schema->dictionary,
+                                        dictionary,
+                                        chunk->dictionary->length));
+    values = PROTECT(Rf_coerceVector(values, STRSXP));
+
+    std::vector<int> codes(Rf_xlength(values));
+    for (R_xlen_t j = 0; j < Rf_xlength(values); j++) {
+      std::string level(Rf_translateCharUTF8(STRING_ELT(values, j)));
+      std::map<std::string, int>::iterator it = levelIndex.find(level);
+      if (it == levelIndex.end()) {
+        levels.push_back(level);
+        it = levelIndex.insert(std::make_pair(level, (int) levels.size())).first;
+      }
+      codes[j] = it->second;
+    }
+    UNPROTECT(2);
+
+    if (format == "c")
+      import_indices<int8_t>(chunk, codes, pData);
+    else if (format == "C")
+      import_indices<uint8_t>(chunk, codes, pData);
+    else if (format == "s")
+      import_indices<int16_t>(chunk, codes, pData);
+    else if (format == "S")
+      import_indices<uint16_t>(chunk, codes, pData);
+    else if (format == "i")
+      import_indices<int32_t>(chunk, codes, pData);
+    else
+      import_indices<int64_t>(chunk, codes, pData);
+
+    pData += chunk->length;
+  }
+
+  SEXP levelsSEXP = PROTECT(Rf_allocVector(STRSXP, levels.size()));
+  for (std::size_t i = 0; i < levels.size(); i++)
+    SET_STRING_ELT(levelsSEXP, i, Rf_mkCharCE(levels[i].c_str(), CE_UTF8));
+  Rf_setAttrib(factor, R_LevelsSymbol, levelsSEXP);
+
+  SEXP classSEXP;
+  if (schema->flags & ARROW_FLAG_DICTIONARY_ORDERED) {
+    classSEXP = PROTECT(Rf_allocVector(STRSXP, 2));
+    SET_STRING_ELT(classSEXP, 0, Rf_mkChar("ordered"));
+    SET_STRING_ELT(classSEXP, 1, Rf_mkChar("factor"));
+  } else {
+    classSEXP = PROTECT(Rf_mkString("factor"));
+  }
+  Rf_setAttrib(factor, R_ClassSymbol, classSEXP);
+
+  UNPROTECT(3);
+  return factor;
+}
+
+// import the chunks of a column into a single R vector
+SEXP import_column(const ArrowSchema* schema,
+                   const std::vector<const ArrowArray*>& chunks,
+                   R_xlen_t length) {
+
+  if (schema->dictionary != NULL)
+    return import_factor(schema, chunks, length);
+
+  std::string format(schema->format);
+  SEXPTYPE type = import_type(format);
+
+  SEXP x = PROTECT(Rf_allocVector(type, length));
+  R_xlen_t start = 0;
+  for (std::size_t i = 0; i < chunks.size(); i++) {
+
+    const ArrowArray* chunk = chunks[i];
+    if (format == "b")
+      import_logicals(chunk, LOGICAL(x) + start);
+    else if (format == "c")
+      import_integers<int8_t>(chunk, INTEGER(x) + start);
+    else if (format == "C")
+      import_integers<uint8_t>(chunk, INTEGER(x) + start);
+    else if (format == "s")
+      import_integers<int16_t>(chunk, INTEGER(x) + start);
+    else if (format == "S")
+      import_integers<uint16_t>(chunk, INTEGER(x) + start);
+    else if (format == "i")
+      import_integers<int32_t>(chunk, INTEGER(x) + start);
+    else if (format == "I")
+      import_doubles<uint32_t>(chunk, REAL(x) + start);
+    else if (format == "l")
+      import_doubles<int64_t>(chunk, REAL(x) + start);
+    else if (format == "L")
+      import_doubles<uint64_t>(chunk, REAL(x) + start);
+    else if (format == "f")
+      import_doubles<float>(chunk, REAL(x) + start);
+    else if (format == "g")
+      import_doubles<double>(chunk, REAL(x) + start);
+    else if (format == "tdD")
+      import_doubles<int32_t>(chunk, REAL(x) + start);
+    else if (format == "tdm")
+      import_doubles<int64_t>(chunk, REAL(x) + start, 1.0 / 86400000);
+    else if (format[0] == 't')
+      import_doubles<int64_t>(chunk, REAL(x) + start, timestamp_scale(format));
+    else if (format == "u")
+      import_strings<int32_t>(chunk, x, start);
+    else
+      import_strings<int64_t>(chunk, x, start);
+
+    start += chunk->length;
+  }
+
+  // dates and timestamps
+  if (format[0] == 't') {
+    if (format[1] == 'd') {
+      Rf_setAttrib(x, R_ClassSymbol, Rf_mkString("Date"));
+    } else {
+      SEXP classSEXP = PROTECT(Rf_allocVector(STRSXP, 2));
+      SET_STRING_ELT(classSEXP, 0, Rf_mkChar("POSIXct"));
+      SET_STRING_ELT(classSEXP, 1, Rf_mkChar("POSIXt"));
+      Rf_setAttrib(x, R_ClassSymbol, classSEXP);
+      UNPROTECT(1);
+
+      // timestamps without a time zone are (like NumPy datetimes) in UTC
+      std::string tz = format.size() > 4 ? format.substr(4) : "UTC";
+      Rf_setAttrib(x, Rf_install("tzone"), Rf_mkString(tz.c_str()));
+    }
+  }
+
+  UNPROTECT(1);
+  return x;
+}
+
+// Export ---------------------------------------------------------------------
+
+// the main thread (R objects can only be released on this thread)
+tthread::thread::id s_main_thread;
+
+// R objects waiting to be released on the main thread
+tthread::mutex s_pending_mutex;
+std::vector<SEXP> s_pending;
+
+void release_object(SEXP object) {
+  if (tthread::this_thread::get_id() == s_main_thread) {
+    R_ReleaseObject(object);
+  } else {
+    tthread::lock_guard<tthread::mutex> lock(s_pending_mutex);
+    s_pending.push_back(object);
+  }
+}
+
+struct SchemaData {
+  std::string format;
+  std::string name;
+  std::vector<ArrowSchema*> children;
+};
+
+struct ArrayData {
+  ArrayData() : object(R_NilValue) {}
+  std::vector<const void*> buffers;
+  std::vector<void*> owned;
+  std::vector<ArrowArray*> children;
+  SEXP object;
+};
+
+void release_schema(ArrowSchema* schema) {
+
+  SchemaData* data = (SchemaData*) schema->private_data;
+  for (std::size_t i = 0; i < data->children.size(); i++) {
+    ArrowSchema* child = data->children[i];
+    if (child->release != NULL)
+      child->release(child);
+    delete child;
+  }
+
+  if (schema->dictionary != NULL) {
+    if (schema->dictionary->release != NULL)
+      schema->dictionary->release(schema->dictionary);
+    delete schema->dictionary;
+  }
+
+  delete data;
+  schema->release = NULL;
+}
+
+void release_array(ArrowArray* array) {
+
+  ArrayData* data = (ArrayData*) array->private_data;
+  for (std::size_t i = 0; i < data->children.size(); i++) {
+    ArrowArray* child = data->children[i];
+    if (child->release != NULL)
+      child->release(child);
+    delete child;
+  }
+
+  if (array->dictionary != NULL) {
+    if (array->dictionary->release != NULL)
+      array->dictionary->release(array->dictionary);
+    delete array->dictionary;
+  }
+
+  for (std::size_t i = 0; i < data->owned.size(); i++)
+    std::free(data->owned[i]);
+
+  if (data->object != R_NilValue)
+    release_object(data->object);
+
+  delete data;
+  array->release = NULL;
+}
+
+void init_schema(ArrowSchema* schema,
+                 const std::string& format,
+                 const std::string& name,
+                 int64_t flags) {
+  SchemaData* data = new SchemaData();
+  data->format = format;
+  data->name = name;
+  schema->format = data->format.c_str();
+  schema->name = data->name.c_str();
+  schema->metadata = NULL;
+  schema->flags = flags;
+  schema->n_children = 0;
+  schema->children = NULL;
+  schema->dictionary = NULL;
+  schema->release = release_schema;
+  schema->private_data = data;
+}
+
+ArrayData* init_array(ArrowArray* array, int64_t length, int n_buffers) {
+  ArrayData* data = new ArrayData();
+  data->buffers.resize(n_buffers, (const void*) NULL);
+  array->length = length;
+  array->null_count = 0;
+  array->offset = 0;
+  array->n_buffers = n_buffers;
+  array->n_children = 0;
+  array->buffers = &data->buffers[0];
+  array->children = NULL;
+  array->dictionary = NULL;
+  array->release = release_array;
+  array->private_data = data;
+  return data;
+}
+
+// allocate a buffer which is owned by (and freed with) an array
+void* allocate_buffer(ArrayData* data, std::size_t size) {
+  void* buffer = std::calloc(size > 0 ? size : 1, 1);
+  if (buffer == NULL)
+    Rcpp::stop("Unable to allocate memory for Arrow buffer");
+  data->owned.push_back(buffer);
+  return buffer;
+}
+
+inline void set_bit(uint8_t* bitmap, int64_t i) {
+  bitmap[i >> 3] |= (uint8_t) (1 << (i & 7));
+}
+
+// create a validity bitmap for an array (only allocated if there are nulls)
+template <typename F>
+void export_validity(ArrowArray* array, ArrayData* data, F is_na) {
+
+  int64_t nulls = 0;
+  for (int64_t i = 0; i < array->length; i++) {
+    if (is_na(i))
+      nulls++;
+  }
+
+  array->null_count = nulls;
+  if (nulls == 0)
+    return;
+
+  uint8_t* bitmap = (uint8_t*) allocate_buffer(data, (array->length + 7) / 8);
+  for (int64_t i = 0; i < array->length; i++) {
+    if (!is_na(i))
+      set_bit(bitmap, i);
+  }
+  data->buffers[0] = bitmap;
+}
+
+struct IntegerIsNA {
+  explicit IntegerIsNA(const int* values) : values(values) {}
+  bool operator()(int64_t i) const { return values[i] == NA_INTEGER; }
+  const int* values;
+};
+
+struct RealIsNA {
+  explicit RealIsNA(const double* values) : values(values) {}
+  bool operator()(int64_t i) const { return R_IsNA(values[i]); }
+  const double* values;
+};
+
+struct RealIsNaN {
+  explicit RealIsNaN(const double* values) : values(values) {}
+  bool operator()(int64_t i) const { return ISNAN(values[i]); }
+  const double* values;
+};
+
+struct StringIsNA {
+  explicit StringIsNA(SEXP x) : x(x) {}
+  bool operator()(int64_t i) const { return STRING_ELT(x, i) == NA_STRING; }
+  SEXP x;
+};
+
+// reference the memory of an R vector from an array (the vector is preserved
+// until the array is released)
+void export_r_memory(ArrayData* data, SEXP x, const void* values) {
+  R_PreserveObject(x);
+  data->object = x;
+  data->buffers[1] = values;
+}
+
+void export_strings(SEXP x, ArrowSchema* schema, ArrowArray* array, const char* name) {
+
+  R_xlen_t n = Rf_xlength(x);
+
+  // determine the total size of the (UTF-8) data so that we can use
+  // 64-bit offsets if required
+  std::vector<const char*> strings(n);
+  std::size_t total = 0;
+  for (R_xlen_t i = 0; i < n; i++) {
+    SEXP elt = STRING_ELT(x, i);
+    strings[i] = elt == NA_STRING ? "" : Rf_translateCharUTF8(elt);
+    total += std::strlen(strings[i]);
+  }
+  bool large = total > (std::size_t) 2147483647;
+
+  init_schema(schema, large ? "U" : "u", name, ARROW_FLAG_NULLABLE);
+  ArrayData* data = init_array(array, n, 3);
+  export_validity(array, data, StringIsNA(x));
+
+  std::size_t offsetSize = large ? sizeof(int64_t) : sizeof(int32_t);
+  void* offsets = allocate_buffer(data, (n + 1) * offsetSize);
+  char* chars = (char*) allocate_buffer(data, total);
+
+  std::size_t offset = 0;
+  for (R_xlen_t i = 0; i < n; i++) {
+    if (large)
+      ((int64_t*) offsets)[i] = offset;
+    else
+      ((int32_t*) offsets)[i] = (int32_t) offset;
+    std::size_t size = std::strlen(strings[i]);
+    std::memcpy(chars + offset, strings[i], size);
+    offset += size;
+  }
+  if (large)
+    ((int64_t*) offsets)[n] = offset;
+  else
+    ((int32_t*) offsets)[n] = (int32_t) offset;
+
+  data->buffers[1] = offsets;
+  data->buffers[2] = chars;
+}
+
+void export_column(SEXP x, ArrowSchema* schema, ArrowArray* array, const char* name) {
+
+  R_xlen_t n = Rf_xlength(x);
+
+  // factors are exported as (32-bit) dictionary indices with a dictionary
+  // of strings
+  if (Rf_isFactor(x)) {
+
+    int64_t flags = ARROW_FLAG_NULLABLE;
+    if (Rf_inherits(x, "ordered"))
+      flags |= ARROW_FLAG_DICTIONARY_ORDERED;
+    init_schema(schema, "i", name, flags);
+
+    ArrayData* data = init_array(array, n, 2);
+    const int* values = INTEGER(x);
+    export_validity(array, data, IntegerIsNA(values));
+    int32_t* indices = (int32_t*) allocate_buffer(data, n * sizeof(int32_t));
+    for (R_xlen_t i = 0; i < n; i++)
+      indices[i] = values[i] == NA_INTEGER ? 0 : values[i] - 1;
+    data->buffers[1] = indices;
+
+    schema->dictionary = new ArrowSchema();
+    array->dictionary = new ArrowArray();
+    export_strings(Rf_getAttrib(x, R_LevelsSymbol),
+                   schema->dictionary,
+                   array->dictionary,
+                   "");
+    return;
+  }
+
+  // POSIXct are exported as timestamps (in microseconds)
+  if (Rf_inherits(x, "POSIXct")) {
+
+    std::string format("tsu:");
+    SEXP tzone = Rf_getAttrib(x, Rf_install("tzone"));
+    if (TYPEOF(tzone) == STRSXP && Rf_length(tzone) > 0)
+      format += Rf_translateCharUTF8(STRING_ELT(tzone, 0));
+    init_schema(schema, format, name, ARROW_FLAG_NULLABLE);
+
+    SEXP seconds = PROTECT(Rf_coerceVector(x, REALSXP));
+    const double* values = REAL(seconds);
+    ArrayData* data = init_array(array, n, 2);
+    export_validity(array, data, RealIsNaN(values));
+    int64_t* micros = (int64_t*) allocate_buffer(data, n * sizeof(int64_t));
+    for (R_xlen_t i = 0; i < n; i++)
+      micros[i] = ISNAN(values[i]) ? 0 : (int64_t) std::floor(values[i] * 1E6 + 0.5);
+    data->buffers[1] = micros;
+    UNPROTECT(1);
+    return;
+  }
+
+  // Date are exported as 32-bit days since the epoch
+  if (Rf_inherits(x, "Date")) {
+
+    init_schema(schema, "tdD", name, ARROW_FLAG_NULLABLE);
+
+    SEXP days = PROTECT(Rf_coerceVector(x, REALSXP));
+    const double* values = REAL(days);
+    ArrayData* data = init_array(array, n, 2);
+    export_validity(array, data, RealIsNaN(values));
+    int32_t* pData = (int32_t*) allocate_buffer(data, n * sizeof(int32_t));
+    for (R_xlen_t i = 0; i < n; i++)
+      pData[i] = ISNAN(values[i]) ? 0 : (int32_t) std::floor(values[i]);
+    data->buffers[1] = pData;
+    UNPROTECT(1);
+    return;
+  }
+
+  switch (TYPEOF(x)) {
+
+  case INTSXP: {
+    init_schema(schema, "i", name, ARROW_FLAG_NULLABLE);
+    ArrayData* data = init_array(array, n, 2);
+    export_validity(array, data, IntegerIsNA(INTEGER(x)));
+    export_r_memory(data, x, INTEGER(x));
+    break;
+  }
+
+  case REALSXP: {
+    init_schema(schema, "g", name, ARROW_FLAG_NULLABLE);
+    ArrayData* data = init_array(array, n, 2);
+    export_validity(array, data, RealIsNA(REAL(x)));
+    export_r_memory(data, x, REAL(x));
+    break;
+  }
+
+  case LGLSXP: {
+    init_schema(schema, "b", name, ARROW_FLAG_NULLABLE);
+    ArrayData* data = init_array(array, n, 2);
+    const int* values = LOGICAL(x);
+    export_validity(array, data, IntegerIsNA(values));
+    uint8_t* bitmap = (uint8_t*) allocate_buffer(data, (n + 7) / 8);
+    for (R_xlen_t i = 0; i < n; i++) {
+      if (values[i] != NA_LOGICAL && values[i])
+        set_bit(bitmap, i);
+    }
+    data->buffers[1] = bitmap;
+    break;
+  }
+
+  case STRSXP:
+    export_strings(x, schema, array, name);
+    break;
+
+  default:
+    Rcpp::stop(std::string("Unable to convert column '") + name + "' to Arrow "
+               "(only numeric, integer, logical, character, factor, Date "
+               "and POSIXct columns are supported)");
+  }
+}
+
+} // anonymous namespace
+
+SEXP import_record_batches(const ArrowSchema* schema,
+                           const std::vector<ArrowArray*>& batches) {
+
+  if (std::string(schema->format) != "+s")
+    Rcpp::stop("Arrow record batches must be struct arrays");
+
+  R_xlen_t length = 0;
+  for (std::size_t i = 0; i < batches.size(); i++)
+    length += batches[i]->length;
+
+  int64_t ncol = schema->n_children;
+  SEXP columns = PROTECT(Rf_allocVector(VECSXP, ncol));
+  SEXP names = PROTECT(Rf_allocVector(STRSXP, ncol));
+  for (int64_t j = 0; j < ncol; j++) {
+
+    const ArrowSchema* child = schema->children[j];
+
+    std::vector<const ArrowArray*> chunks(batches.size());
+    for (std::size_t i = 0; i < batches.size(); i++) {
+      if (batches[i]->offset != 0)
+        Rcpp::stop("Arrow record batches with an offset are not supported");
+      chunks[i] = batches[i]->children[j];
+    }
+
+    SET_VECTOR_ELT(columns, j, import_column(child, chunks, length));
+    const char* name = child->name != NULL ? child->name : "";
+    SET_STRING_ELT(names, j, Rf_mkCharCE(name, CE_UTF8));
+  }
+
+  Rf_setAttrib(columns, R_NamesSymbol, names);
+  UNPROTECT(2);
+  return columns;
+}
+
+void export_data_frame(SEXP data, ArrowSchema* schema, ArrowArray* array) {
+
+  s_main_thread = tthread::this_thread::get_id();
+
+  SEXP names = Rf_getAttrib(data, R_NamesSymbol);
+  int64_t ncol = Rf_xlength(data);
+  int64_t nrow = Rf_xlength(Rf_getAttrib(data, R_RowNamesSymbol));
+
+  init_schema(schema, "+s", "", 0);
+  ArrayData* arrayData = init_array(array, nrow, 1);
+  SchemaData* schemaData = (SchemaData*) schema->private_data;
+
+  // the children are attached as they are created so that they will be
+  // released along with their parent should an error occur
+  for (int64_t j = 0; j < ncol; j++) {
+
+    ArrowSchema* childSchema = new ArrowSchema();
+    childSchema->release = NULL;
+    schemaData->children.push_back(childSchema);
+    schema->children = &schemaData->children[0];
+    schema->n_children = j + 1;
+
+    ArrowArray* childArray = new ArrowArray();
+    childArray->release = NULL;
+    arrayData->children.push_back(childArray);
+    array->children = &arrayData->children[0];
+    array->n_children = j + 1;
+
+    const char* name = Rf_translateCharUTF8(STRING_ELT(names, j));
+    export_column(VECTOR_ELT(data, j), childSchema, childArray, name);
+  }
+}
+
+void release_pending() {
+
+  std::vector<SEXP> pending;
+  {
+    tthread::lock_guard<tthread::mutex> lock(s_pending_mutex);
+    pending.swap(s_pending);
+  }
+
+  for (std::size_t i = 0; i < pending.size(); i++)
+    R_ReleaseObject(pending[i]);
+}
+
+} // namespace arrow
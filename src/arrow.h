@@ -0,0 +1,78 @@
+
+#ifndef __RETICULATE_ARROW__
+#define __RETICULATE_ARROW__
+
+#include <Rinternals.h>
+
+#include <stdint.h>
+
+#include <vector>
+
+// Apache Arrow C Data Interface (these definitions are ABI stable and are
+// reproduced verbatim from the specification so that we don't need to
+// depend on the Arrow C++ libraries)
+// https://arrow.apache.org/docs/format/CDataInterface.html
+
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+  // Array type description
+  const char* format;
+  const char* name;
+  const char* metadata;
+  int64_t flags;
+  int64_t n_children;
+  struct ArrowSchema** children;
+  struct ArrowSchema* dictionary;
+
+  // Release callback
+  void (*release)(struct ArrowSchema*);
+  // Opaque producer-specific data
+  void* private_data;
+};
+
+struct ArrowArray {
+  // Array data description
+  int64_t length;
+  int64_t null_count;
+  int64_t offset;
+  int64_t n_buffers;
+  int64_t n_children;
+  const void** buffers;
+  struct ArrowArray** children;
+  struct ArrowArray* dictionary;
+
+  // Release callback
+  void (*release)(struct ArrowArray*);
+  // Opaque producer-specific data
+  void* private_data;
+};
+
+#endif // ARROW_C_DATA_INTERFACE
+
+namespace arrow {
+
+// convert a set of record batches (struct arrays, all described by 'schema')
+// into a named list of R vectors, with the rows of each batch appended in
+// order. the arrays are not released.
+SEXP import_record_batches(const struct ArrowSchema* schema,
+                           const std::vector<struct ArrowArray*>& batches);
+
+// export the columns of an R data.frame as a record batch (struct array).
+// the exported buffers reference the memory of numeric columns directly
+// where possible; ownership of 'schema' and 'array' passes to the consumer,
+// which must call their release callbacks.
+void export_data_frame(SEXP data, struct ArrowSchema* schema, struct ArrowArray* array);
+
+// release R objects which were referenced by exported arrays that have since
+// been released from a thread other than the main thread
+void release_pending();
+
+} // namespace arrow
+
+#endif // __RETICULATE_ARROW__
@@ -29,8 +29,28 @@
 // requested, which will ultimately result in a KeyboardInterrupt error being
 // raised.
 //
+// Polling is adaptive: when Python code starts executing the background
+// thread polls at a short interval (tighter in interactive sessions, where
+// interrupts and GUI events matter most), then backs off exponentially up to
+// a maximum interval for long running computations. When the interpreter is
+// no longer running the background thread blocks on a condition variable
+// until Python code is executed again, rather than waking up periodically.
+// Polling can be switched off entirely (e.g. for headless production jobs)
+// with options(reticulate.event_polling = FALSE), or given a different
+// initial interval (in milliseconds) with e.g.
+// options(reticulate.event_polling = 100).
+//
+// The same machinery is used to run work on behalf of background threads which
+// need to call into R (e.g. R generators used from Python worker threads).
+// Such work is pushed onto a lock-free multiple-producer, single-consumer
+// queue; the producer which finds the queue empty schedules a single pending
+// call, which then runs everything queued so far on the main thread. Since
+// only the transition from empty to non-empty schedules a call, any number
+// of queued tasks share one pending call slot.
+//
 
 #include "event_loop.h"
+#include "stats.h"
 
 #include "libpython.h"
 using namespace libpython;
@@ -55,56 +75,242 @@ namespace {
 // continually scheduling pollForEvents even when the Python interpreter is
 // not running (because once pollForEvents is no longer being called by the
 // Python interpreter no additonal calls to pollForEvents will be
-// scheduled)
+// scheduled). The flag is updated atomically so that the main thread never
+// needs to take a lock.
 class EventPollingSignal {
 public:
-  EventPollingSignal() : pollingRequested_(true) {}
+  EventPollingSignal() : pollingRequested_(1) {}
 
   void requestPolling() {
-    lock_guard<mutex> lock(mutex_);
-    pollingRequested_ = true;
+    __sync_lock_test_and_set(&pollingRequested_, 1);
   }
 
   bool collectRequest() {
-    lock_guard<mutex> lock(mutex_);
-    bool requested = pollingRequested_;
-    pollingRequested_ = false;
-    return requested;
+    return __sync_lock_test_and_set(&pollingRequested_, 0) != 0;
   }
 
 private:
   EventPollingSignal(const EventPollingSignal& other);
   EventPollingSignal& operator=(const EventPollingSignal&);
 private:
-  mutex mutex_;
-  bool pollingRequested_;
+  volatile int pollingRequested_;
 };
 
 EventPollingSignal s_pollingSignal;
 
+// Node in the queue of tasks to be run on the main thread
+struct QueuedTask {
+  Task task;
+  void* data;
+  QueuedTask* next;
+};
+
+// Lock-free multiple-producer, single-consumer queue of tasks. Producers push
+// onto the head of an intrusive singly-linked list; the consumer detaches the
+// entire list at once and runs it in reverse (i.e. scheduling) order. Since
+// the consumer never removes individual nodes the list isn't subject to the
+// ABA problem.
+class TaskQueue {
+public:
+  TaskQueue() : head_(NULL), wakeupFailed_(0) {}
+
+  // returns true if the queue was previously empty
+  bool push(QueuedTask* node) {
+    QueuedTask* head;
+    do {
+      head = head_;
+      node->next = head;
+    } while (!__sync_bool_compare_and_swap(&head_, head, node));
+    return head == NULL;
+  }
+
+  // detach all queued tasks (returned in the order they were pushed)
+  QueuedTask* takeAll() {
+    QueuedTask* head;
+    do {
+      head = head_;
+    } while (!__sync_bool_compare_and_swap(&head_, head, (QueuedTask*) NULL));
+
+    QueuedTask* reversed = NULL;
+    while (head != NULL) {
+      QueuedTask* next = head->next;
+      head->next = reversed;
+      reversed = head;
+      head = next;
+    }
+    return reversed;
+  }
+
+  bool empty() const {
+    return head_ == NULL;
+  }
+
+  // record / collect a failure to schedule the pending call which drains
+  // the queue (so the background polling thread can retry)
+  void setWakeupFailed(bool failed) {
+    __sync_lock_test_and_set(&wakeupFailed_, failed ? 1 : 0);
+  }
+
+  bool collectWakeupFailed() {
+    return __sync_lock_test_and_set(&wakeupFailed_, 0) != 0;
+  }
+
+  bool wakeupFailed() const {
+    return wakeupFailed_ != 0;
+  }
+
+private:
+  TaskQueue(const TaskQueue& other);
+  TaskQueue& operator=(const TaskQueue&);
+private:
+  QueuedTask* volatile head_;
+  volatile int wakeupFailed_;
+};
+
+TaskQueue s_taskQueue;
+
+// Polling intervals (in milliseconds) used by default in interactive and
+// batch sessions. In each case polling starts at the minimum interval and
+// doubles each time the interpreter is still running, up to the maximum.
+const int kInteractiveMinIntervalMs = 25;
+const int kInteractiveMaxIntervalMs = 250;
+const int kBatchMinIntervalMs = 250;
+const int kBatchMaxIntervalMs = 5000;
+
+// Schedule used by the background thread. The thread is 'active' while the
+// Python interpreter is (or may be) executing code; when inactive it waits on
+// a condition variable which is signalled when Python code is next executed
+// (or when the task queue needs attention).
+class PollingSchedule {
+public:
+  PollingSchedule()
+    : enabled_(true),
+      minIntervalMs_(kInteractiveMinIntervalMs),
+      maxIntervalMs_(kInteractiveMaxIntervalMs),
+      intervalMs_(kInteractiveMinIntervalMs),
+      active_(0) {}
+
+  void configure(bool enabled, int minIntervalMs, int maxIntervalMs) {
+    enabled_ = enabled;
+    minIntervalMs_ = minIntervalMs;
+    maxIntervalMs_ = maxIntervalMs < minIntervalMs ? minIntervalMs : maxIntervalMs;
+    intervalMs_ = minIntervalMs_;
+  }
+
+  bool enabled() const {
+    return enabled_;
+  }
+
+  int interval() const {
+    return intervalMs_;
+  }
+
+  // double the polling interval (up to the maximum)
+  void backoff() {
+    intervalMs_ = intervalMs_ * 2 > maxIntervalMs_ ? maxIntervalMs_ : intervalMs_ * 2;
+  }
+
+  bool isActive() const {
+    return active_ != 0;
+  }
+
+  // called (on any thread) when Python code is about to be executed
+  void activate() {
+    if (!enabled_)
+      return;
+    if (active_ == 0 && __sync_bool_compare_and_swap(&active_, 0, 1))
+      wake();
+  }
+
+  // called by the background thread when the interpreter has stopped
+  // running. if polling was requested again in the meantime (i.e. a racing
+  // call to activate() saw us as still active) we remain active.
+  void deactivate(EventPollingSignal& signal) {
+    __sync_lock_test_and_set(&active_, 0);
+    intervalMs_ = minIntervalMs_;
+    if (signal.collectRequest())
+      __sync_lock_test_and_set(&active_, 1);
+  }
+
+  // wake the background thread
+  void wake() {
+    lock_guard<mutex> lock(mutex_);
+    cond_.notify_one();
+  }
+
+  // block the background thread until 'ready' returns true
+  void waitUntil(bool (*ready)()) {
+    lock_guard<mutex> lock(mutex_);
+    while (!ready())
+      cond_.wait(mutex_);
+  }
+
+private:
+  PollingSchedule(const PollingSchedule& other);
+  PollingSchedule& operator=(const PollingSchedule&);
+private:
+  bool enabled_;
+  int minIntervalMs_;
+  int maxIntervalMs_;
+  int intervalMs_;
+  volatile int active_;
+  mutex mutex_;
+  condition_variable cond_;
+};
+
+PollingSchedule s_schedule;
+
 extern "C" {
 
 // Forward declarations
 int pollForEvents(void*);
+int runQueuedTasks(void*);
 void checkUserInterrupt(void*);
 
+// Schedule a call to runQueuedTasks on the main thread (if this fails, e.g.
+// because Python's pending call buffer is full, the polling worker retries)
+void wakeMainThread() {
+  bool failed = Py_AddPendingCall(runQueuedTasks, NULL) != 0;
+  s_taskQueue.setWakeupFailed(failed);
+  if (failed)
+    s_schedule.wake();
+}
+
+// Check whether the background thread has anything to do
+bool workerHasWork() {
+  return s_schedule.isActive() || s_taskQueue.wakeupFailed();
+}
+
 // Background thread which re-schedules pollForEvents on the main Python
-// interpreter thread every 250ms so long as the Python interpeter is still
-// running (when it stops running it will stop calling pollForEvents and
-// the polling signal will not be set).
+// interpreter thread so long as the Python interpeter is still running
+// (when it stops running it will stop calling pollForEvents and the polling
+// signal will not be set, at which point we wait until it is next started).
 void eventPollingWorker(void *) {
   while(true) {
 
+    // Wait for Python code to be executed
+    s_schedule.waitUntil(workerHasWork);
+
     // Throttle via sleep
-    this_thread::sleep_for(chrono::milliseconds(250));
+    this_thread::sleep_for(chrono::milliseconds(s_schedule.interval()));
 
     // Schedule polling on the main thread if the interpeter is still running
     // Note that Py_AddPendingCall is documented to be callable from a background
     // thread: "This function doesn’t need a current thread state to run, and it
     // doesn’t need the global interpreter lock."
     // (see: https://docs.python.org/3/c-api/init.html#c.Py_AddPendingCall)
-    if (s_pollingSignal.collectRequest())
-      Py_AddPendingCall(pollForEvents, NULL);
+    if (s_schedule.isActive()) {
+      if (s_pollingSignal.collectRequest()) {
+        Py_AddPendingCall(pollForEvents, NULL);
+        s_schedule.backoff();
+      } else {
+        s_schedule.deactivate(s_pollingSignal);
+      }
+    }
+
+    // Retry waking the main thread if we previously failed to do so
+    if (s_taskQueue.collectWakeupFailed() && !s_taskQueue.empty())
+      wakeMainThread();
 
   }
 }
@@ -117,6 +323,8 @@ void eventPollingWorker(void *) {
 // the scheduling of the function by using a background thread + a sleep timer.
 int pollForEvents(void*) {
 
+  stats::poll_tick();
+
   // Check whether an interrupt has been requested by the user. If one
   // has then set the Python interrupt flag (which will soon after result
   // in a KeyboardInterrupt error being thrown).
@@ -133,6 +341,39 @@ int pollForEvents(void*) {
 }
 
 
+// Callback function scheduled to run on the main Python interpreter loop
+// when tasks are added to the (previously empty) task queue. All tasks queued
+// at the time of the call are run. If a task fails, the remaining tasks are
+// still run (their callers are waiting on them) and the first error is then
+// reported to the interpreter.
+int runQueuedTasks(void*) {
+
+  PyObject *type = NULL, *value = NULL, *traceback = NULL;
+
+  QueuedTask* node = s_taskQueue.takeAll();
+  while (node != NULL) {
+
+    if (node->task(node->data) != 0) {
+      if (type == NULL)
+        PyErr_Fetch(&type, &value, &traceback);
+      else
+        PyErr_Clear();
+    }
+
+    QueuedTask* next = node->next;
+    delete node;
+    stats::task_completed();
+    node = next;
+  }
+
+  if (type != NULL) {
+    PyErr_Restore(type, value, traceback);
+    return -1;
+  }
+
+  return 0;
+}
+
 // Wrapper for calling R_CheckUserInterrupt within R_TolevelExec. Note that
 // this call will result in R calling it's internal R_ProcessEvents function
 // which will allow front-ends to pump events, set the interrupt pending flag,
@@ -147,10 +388,42 @@ void checkUserInterrupt(void*) {
 
 
 // Initialize event loop polling background thread
-void initialize() {
+void initialize(bool interactive, int intervalMs) {
+
+  if (intervalMs < 0) {
+    s_schedule.configure(false, 0, 0);
+  } else if (intervalMs > 0) {
+    int maxIntervalMs = interactive ? kInteractiveMaxIntervalMs : kBatchMaxIntervalMs;
+    s_schedule.configure(true, intervalMs, maxIntervalMs);
+  } else if (interactive) {
+    s_schedule.configure(true, kInteractiveMinIntervalMs, kInteractiveMaxIntervalMs);
+  } else {
+    s_schedule.configure(true, kBatchMinIntervalMs, kBatchMaxIntervalMs);
+  }
+
+  // the thread is always started, since it also retries scheduling of
+  // queued tasks
   thread t(eventPollingWorker, NULL);
   t.detach();
 }
 
+void activate() {
+  if (!s_schedule.enabled())
+    return;
+  s_pollingSignal.requestPolling();
+  s_schedule.activate();
+}
+
+void schedule(Task task, void* data) {
+
+  QueuedTask* node = new QueuedTask();
+  node->task = task;
+  node->data = data;
+
+  stats::task_scheduled();
+  if (s_taskQueue.push(node))
+    wakeMainThread();
+}
+
 } // namespace event_loop
 
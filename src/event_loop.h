@@ -4,7 +4,23 @@
 
 namespace event_loop {
 
-void initialize();
+// start the background thread which polls for events (interrupts, GUI events)
+// while Python code is executing. 'intervalMs' is the initial polling
+// interval in milliseconds: 0 selects a default appropriate for interactive
+// or batch sessions, and a negative value disables polling.
+void initialize(bool interactive, int intervalMs);
+
+// notify the event loop that Python code may be about to be executed (cheap
+// when polling is already active). called whenever the GIL is acquired for
+// code running in R (see GILScope).
+void activate();
+
+// schedule a function to be called on the main thread while the Python
+// interpreter is running. this may be called from any thread (it doesn't
+// require the GIL); functions are called in the order they were scheduled.
+// a function may return -1 (with a Python error set) to indicate failure.
+typedef int (*Task)(void*);
+void schedule(Task task, void* data);
 
 } // namespace event_loop
 
@@ -0,0 +1,735 @@
+
+#include "kernels.h"
+
+#include "tinythread.h"
+
+#include <Rinternals.h>
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+// SIMD support: AVX2 kernels are compiled using target attributes (so the
+// package itself doesn't need to be built with -mavx2) and selected at
+// runtime; NEON is always available on 64-bit ARM
+#if defined(__x86_64__) || defined(__i386__)
+# if (defined(__clang__) && __clang_major__ >= 4) || \
+     (!defined(__clang__) && defined(__GNUC__) && __GNUC__ >= 5)
+#  define RETICULATE_KERNELS_AVX2 1
+#  include <immintrin.h>
+# endif
+#elif defined(__aarch64__)
+# define RETICULATE_KERNELS_NEON 1
+# include <arm_neon.h>
+#endif
+
+using namespace libpython;
+
+namespace kernels {
+
+namespace {
+
+// arrays with at least this many elements are converted in parallel, using
+// at most kMaxThreads threads each converting at least kMinChunk elements
+const npy_intp kParallelThreshold = 1 << 22;
+const npy_intp kMinChunk = 1 << 20;
+const unsigned kMaxThreads = 8;
+
+// conversions queued in a batch are split into pieces of at most this many
+// elements (so that the work can be balanced across the threads)
+const npy_intp kBatchChunk = 1 << 18;
+
+template <typename S, typename D>
+void convert_scalar(const S* src, D* dst, npy_intp n) {
+  for (npy_intp i = 0; i < n; i++)
+    dst[i] = (D) src[i];
+}
+
+// IEEE 754 half precision to double
+inline double half_to_double(uint16_t value) {
+
+  int exponent = (value >> 10) & 0x1F;
+  int mantissa = value & 0x3FF;
+
+  double result;
+  if (exponent == 0)
+    result = std::ldexp((double) mantissa, -24);
+  else if (exponent == 31)
+    result = mantissa == 0 ?
+      std::numeric_limits<double>::infinity() :
+      std::numeric_limits<double>::quiet_NaN();
+  else
+    result = std::ldexp((double) (mantissa | 0x400), exponent - 25);
+
+  return (value & 0x8000) ? -result : result;
+}
+
+void half_to_double(const uint16_t* src, double* dst, npy_intp n) {
+  for (npy_intp i = 0; i < n; i++)
+    dst[i] = half_to_double(src[i]);
+}
+
+#ifdef RETICULATE_KERNELS_AVX2
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+// (a local static, so that it's initialized just once even when first called
+// from the worker threads)
+bool detect_avx2() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") != 0;
+}
+
+bool has_avx2() {
+  static const bool supported = detect_avx2();
+  return supported;
+}
+
+AVX2_TARGET void int8_to_int_avx2(const int8_t* src, int* dst, npy_intp n) {
+  npy_intp i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i x = _mm_loadl_epi64((const __m128i*) (src + i));
+    _mm256_storeu_si256((__m256i*) (dst + i), _mm256_cvtepi8_epi32(x));
+  }
+  convert_scalar(src + i, dst + i, n - i);
+}
+
+AVX2_TARGET void uint8_to_int_avx2(const uint8_t* src, int* dst, npy_intp n) {
+  npy_intp i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i x = _mm_loadl_epi64((const __m128i*) (src + i));
+    _mm256_storeu_si256((__m256i*) (dst + i), _mm256_cvtepu8_epi32(x));
+  }
+  convert_scalar(src + i, dst + i, n - i);
+}
+
+AVX2_TARGET void int16_to_int_avx2(const int16_t* src, int* dst, npy_intp n) {
+  npy_intp i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i x = _mm_loadu_si128((const __m128i*) (src + i));
+    _mm256_storeu_si256((__m256i*) (dst + i), _mm256_cvtepi16_epi32(x));
+  }
+  convert_scalar(src + i, dst + i, n - i);
+}
+
+AVX2_TARGET void uint16_to_int_avx2(const uint16_t* src, int* dst, npy_intp n) {
+  npy_intp i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i x = _mm_loadu_si128((const __m128i*) (src + i));
+    _mm256_storeu_si256((__m256i*) (dst + i), _mm256_cvtepu16_epi32(x));
+  }
+  convert_scalar(src + i, dst + i, n - i);
+}
+
+AVX2_TARGET void int32_to_double_avx2(const int32_t* src, double* dst, npy_intp n) {
+  npy_intp i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i x = _mm_loadu_si128((const __m128i*) (src + i));
+    _mm256_storeu_pd(dst + i, _mm256_cvtepi32_pd(x));
+  }
+  convert_scalar(src + i, dst + i, n - i);
+}
+
+AVX2_TARGET void uint32_to_double_avx2(const uint32_t* src, double* dst, npy_intp n) {
+  // convert as signed integers, then add 2^32 to values which came out negative
+  const __m256d zero = _mm256_setzero_pd();
+  const __m256d offset = _mm256_set1_pd(4294967296.0);
+  npy_intp i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i x = _mm_loadu_si128((const __m128i*) (src + i));
+    __m256d value = _mm256_cvtepi32_pd(x);
+    __m256d negative = _mm256_cmp_pd(value, zero, _CMP_LT_OQ);
+    value = _mm256_add_pd(value, _mm256_and_pd(negative, offset));
+    _mm256_storeu_pd(dst + i, value);
+  }
+  convert_scalar(src + i, dst + i, n - i);
+}
+
+AVX2_TARGET void float_to_double_avx2(const float* src, double* dst, npy_intp n) {
+  npy_intp i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm256_storeu_pd(dst + i, _mm256_cvtps_pd(_mm_loadu_ps(src + i)));
+  convert_scalar(src + i, dst + i, n - i);
+}
+
+AVX2_TARGET void logical_to_bool_avx2(const int* src, npy_bool* dst, npy_intp n) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+  npy_intp i = 0;
+  for (; i + 32 <= n; i += 32) {
+    // 0 or 1 for each element (the comparison yields -1 for zero elements)
+    __m256i a = _mm256_add_epi32(_mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*) (src + i)), zero), one);
+    __m256i b = _mm256_add_epi32(_mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*) (src + i + 8)), zero), one);
+    __m256i c = _mm256_add_epi32(_mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*) (src + i + 16)), zero), one);
+    __m256i d = _mm256_add_epi32(_mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*) (src + i + 24)), zero), one);
+    // pack to bytes (packing works within 128-bit lanes, so restore the order)
+    __m256i packed = _mm256_packs_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d));
+    _mm256_storeu_si256((__m256i*) (dst + i), _mm256_permutevar8x32_epi32(packed, order));
+  }
+  for (; i < n; i++)
+    dst[i] = src[i] != 0;
+}
+
+#endif // RETICULATE_KERNELS_AVX2
+
+#ifdef RETICULATE_KERNELS_NEON
+
+void int8_to_int_neon(const int8_t* src, int* dst, npy_intp n) {
+  npy_intp i = 0;
+  for (; i + 8 <= n; i += 8) {
+    int16x8_t x = vmovl_s8(vld1_s8(src + i));
+    vst1q_s32((int32_t*) (dst + i), vmovl_s16(vget_low_s16(x)));
+    vst1q_s32((int32_t*) (dst + i + 4), vmovl_s16(vget_high_s16(x)));
+  }
+  convert_scalar(src + i, dst + i, n - i);
+}
+
+void uint8_to_int_neon(const uint8_t* src, int* dst, npy_intp n) {
+  npy_intp i = 0;
+  for (; i + 8 <= n; i += 8) {
+    uint16x8_t x = vmovl_u8(vld1_u8(src + i));
+    vst1q_u32((uint32_t*) (dst + i), vmovl_u16(vget_low_u16(x)));
+    vst1q_u32((uint32_t*) (dst + i + 4), vmovl_u16(vget_high_u16(x)));
+  }
+  convert_scalar(src + i, dst + i, n - i);
+}
+
+void int16_to_int_neon(const int16_t* src, int* dst, npy_intp n) {
+  npy_intp i = 0;
+  for (; i + 8 <= n; i += 8) {
+    int16x8_t x = vld1q_s16(src + i);
+    vst1q_s32((int32_t*) (dst + i), vmovl_s16(vget_low_s16(x)));
+    vst1q_s32((int32_t*) (dst + i + 4), vmovl_s16(vget_high_s16(x)));
+  }
+  convert_scalar(src + i, dst + i, n - i);
+}
+
+void uint16_to_int_neon(const uint16_t* src, int* dst, npy_intp n) {
+  npy_intp i = 0;
+  for (; i + 8 <= n; i += 8) {
+    uint16x8_t x = vld1q_u16(src + i);
+    vst1q_u32((uint32_t*) (dst + i), vmovl_u16(vget_low_u16(x)));
+    vst1q_u32((uint32_t*) (dst + i + 4), vmovl_u16(vget_high_u16(x)));
+  }
+  convert_scalar(src + i, dst + i, n - i);
+}
+
+void int32_to_double_neon(const int32_t* src, double* dst, npy_intp n) {
+  npy_intp i = 0;
+  for (; i + 4 <= n; i += 4) {
+    int32x4_t x = vld1q_s32(src + i);
+    vst1q_f64(dst + i, vcvtq_f64_s64(vmovl_s32(vget_low_s32(x))));
+    vst1q_f64(dst + i + 2, vcvtq_f64_s64(vmovl_s32(vget_high_s32(x))));
+  }
+  convert_scalar(src + i, dst + i, n - i);
+}
+
+void uint32_to_double_neon(const uint32_t* src, double* dst, npy_intp n) {
+  npy_intp i = 0;
+  for (; i + 4 <= n; i += 4) {
+    uint32x4_t x = vld1q_u32(src + i);
+    vst1q_f64(dst + i, vcvtq_f64_u64(vmovl_u32(vget_low_u32(x))));
+    vst1q_f64(dst + i + 2, vcvtq_f64_u64(vmovl_u32(vget_high_u32(x))));
+  }
+  convert_scalar(src + i, dst + i, n - i);
+}
+
+void int64_to_double_neon(const int64_t* src, double* dst, npy_intp n) {
+  npy_intp i = 0;
+  for (; i + 2 <= n; i += 2)
+    vst1q_f64(dst + i, vcvtq_f64_s64(vld1q_s64(src + i)));
+  convert_scalar(src + i, dst + i, n - i);
+}
+
+void uint64_to_double_neon(const uint64_t* src, double* dst, npy_intp n) {
+  npy_intp i = 0;
+  for (; i + 2 <= n; i += 2)
+    vst1q_f64(dst + i, vcvtq_f64_u64(vld1q_u64(src + i)));
+  convert_scalar(src + i, dst + i, n - i);
+}
+
+void float_to_double_neon(const float* src, double* dst, npy_intp n) {
+  npy_intp i = 0;
+  for (; i + 4 <= n; i += 4) {
+    float32x4_t x = vld1q_f32(src + i);
+    vst1q_f64(dst + i, vcvt_f64_f32(vget_low_f32(x)));
+    vst1q_f64(dst + i + 2, vcvt_high_f64_f32(x));
+  }
+  convert_scalar(src + i, dst + i, n - i);
+}
+
+void logical_to_bool_neon(const int* src, npy_bool* dst, npy_intp n) {
+  const uint8x8_t one = vdup_n_u8(1);
+  npy_intp i = 0;
+  for (; i + 8 <= n; i += 8) {
+    int32x4_t a = vld1q_s32((const int32_t*) (src + i));
+    int32x4_t b = vld1q_s32((const int32_t*) (src + i + 4));
+    uint16x8_t mask = vcombine_u16(vmovn_u32(vtstq_s32(a, a)), vmovn_u32(vtstq_s32(b, b)));
+    vst1_u8(dst + i, vand_u8(vmovn_u16(mask), one));
+  }
+  for (; i < n; i++)
+    dst[i] = src[i] != 0;
+}
+
+#endif // RETICULATE_KERNELS_NEON
+
+// select the best available implementation of each kernel
+
+#if defined(RETICULATE_KERNELS_AVX2)
+# define DISPATCH_AVX2(name) if (has_avx2()) return name##_avx2(src, dst, n)
+#else
+# define DISPATCH_AVX2(name)
+#endif
+
+#if defined(RETICULATE_KERNELS_NEON)
+# define DISPATCH_NEON(name) return name##_neon(src, dst, n)
+#else
+# define DISPATCH_NEON(name)
+#endif
+
+void int8_to_int(const int8_t* src, int* dst, npy_intp n) {
+  DISPATCH_AVX2(int8_to_int);
+  DISPATCH_NEON(int8_to_int);
+  convert_scalar(src, dst, n);
+}
+
+void uint8_to_int(const uint8_t* src, int* dst, npy_intp n) {
+  DISPATCH_AVX2(uint8_to_int);
+  DISPATCH_NEON(uint8_to_int);
+  convert_scalar(src, dst, n);
+}
+
+void int16_to_int(const int16_t* src, int* dst, npy_intp n) {
+  DISPATCH_AVX2(int16_to_int);
+  DISPATCH_NEON(int16_to_int);
+  convert_scalar(src, dst, n);
+}
+
+void uint16_to_int(const uint16_t* src, int* dst, npy_intp n) {
+  DISPATCH_AVX2(uint16_to_int);
+  DISPATCH_NEON(uint16_to_int);
+  convert_scalar(src, dst, n);
+}
+
+void int32_to_double(const int32_t* src, double* dst, npy_intp n) {
+  DISPATCH_AVX2(int32_to_double);
+  DISPATCH_NEON(int32_to_double);
+  convert_scalar(src, dst, n);
+}
+
+void uint32_to_double(const uint32_t* src, double* dst, npy_intp n) {
+  DISPATCH_AVX2(uint32_to_double);
+  DISPATCH_NEON(uint32_to_double);
+  convert_scalar(src, dst, n);
+}
+
+// (AVX2 has no 64-bit integer to double conversion)
+void int64_to_double(const int64_t* src, double* dst, npy_intp n) {
+  DISPATCH_NEON(int64_to_double);
+  convert_scalar(src, dst, n);
+}
+
+void uint64_to_double(const uint64_t* src, double* dst, npy_intp n) {
+  DISPATCH_NEON(uint64_to_double);
+  convert_scalar(src, dst, n);
+}
+
+void float_to_double(const float* src, double* dst, npy_intp n) {
+  DISPATCH_AVX2(float_to_double);
+  DISPATCH_NEON(float_to_double);
+  convert_scalar(src, dst, n);
+}
+
+void logical_to_bool(const int* src, npy_bool* dst, npy_intp n) {
+  DISPATCH_AVX2(logical_to_bool);
+  DISPATCH_NEON(logical_to_bool);
+  for (npy_intp i = 0; i < n; i++)
+    dst[i] = src[i] != 0;
+}
+
+void copy_int(const int32_t* src, int* dst, npy_intp n) {
+  std::memcpy(dst, src, n * sizeof(int));
+}
+
+void copy_double(const double* src, double* dst, npy_intp n) {
+  std::memcpy(dst, src, n * sizeof(double));
+}
+
+// a pool of worker threads, started as they're first needed and then kept
+// waiting on a condition variable between jobs (so that converting many
+// arrays doesn't start new threads each time). a job is a function called
+// for the items 0..count-1, which the calling thread and the workers take in
+// turn. jobs are only run from the main thread (with the GIL held), and the
+// workers are never stopped (they're detached, and end with the process).
+// as the calling thread takes items too, every job completes even when the
+// workers aren't running (e.g. in a forked child process).
+class WorkerPool {
+public:
+
+  typedef void (*Function)(void* data, std::size_t item);
+
+  WorkerPool()
+    : started_(0), function_(NULL), data_(NULL), count_(0), next_(0), done_(0) {}
+
+  // run 'function' for each of the 'count' items, using this thread and up
+  // to 'workers' threads of the pool, returning once all items are done
+  void run(Function function, void* data, std::size_t count, std::size_t workers) {
+
+    tthread::lock_guard<tthread::mutex> lock(mutex_);
+
+    // start any more workers needed (if a thread can't be started, the items
+    // are just taken by the threads which are running)
+    while (started_ < workers) {
+      tthread::thread worker(WorkerPool::loop, this);
+      if (!worker.joinable())
+        break;
+      worker.detach();
+      started_++;
+    }
+
+    function_ = function;
+    data_ = data;
+    count_ = count;
+    next_ = 0;
+    done_ = 0;
+    work_.notify_all();
+
+    take();
+    while (done_ < count_)
+      finished_.wait(mutex_);
+
+    // nothing left for the workers to take until the next job
+    count_ = 0;
+    next_ = 0;
+  }
+
+private:
+
+  // take and run items until there are none left (with mutex_ held)
+  void take() {
+    while (next_ < count_) {
+      std::size_t item = next_++;
+      Function function = function_;
+      void* data = data_;
+      mutex_.unlock();
+      function(data, item);
+      mutex_.lock();
+      if (++done_ == count_)
+        finished_.notify_all();
+    }
+  }
+
+  static void loop(void* data) {
+    WorkerPool* pool = (WorkerPool*) data;
+    tthread::lock_guard<tthread::mutex> lock(pool->mutex_);
+    for (;;) {
+      while (pool->next_ >= pool->count_)
+        pool->work_.wait(pool->mutex_);
+      pool->take();
+    }
+  }
+
+  tthread::mutex mutex_;
+  tthread::condition_variable work_;
+  tthread::condition_variable finished_;
+  std::size_t started_;
+  Function function_;
+  void* data_;
+  std::size_t count_;
+  std::size_t next_;
+  std::size_t done_;
+};
+
+// the pool is never destroyed, as its workers may still be waiting on it
+// while the process exits
+WorkerPool& worker_pool() {
+  static WorkerPool* pool = new WorkerPool();
+  return *pool;
+}
+
+// a slice of a conversion to be run by the worker pool
+template <typename S, typename D>
+struct ConversionTask {
+
+  void (*kernel)(const S*, D*, npy_intp);
+  const S* src;
+  D* dst;
+  npy_intp n;
+
+  static void run(void* data, std::size_t item) {
+    ConversionTask* task = (ConversionTask*) data + item;
+    task->kernel(task->src, task->dst, task->n);
+  }
+};
+
+template <typename S, typename D>
+void invoke(Batch::Kernel kernel, const void* src, void* dst, npy_intp n) {
+  ((void (*)(const S*, D*, npy_intp)) kernel)((const S*) src, (D*) dst, n);
+}
+
+// the number of threads to use for converting 'n' elements
+npy_intp thread_count(npy_intp n) {
+  npy_intp threads = tthread::thread::hardware_concurrency();
+  if (threads > (npy_intp) kMaxThreads)
+    threads = kMaxThreads;
+  if (threads > n / kMinChunk)
+    threads = n / kMinChunk;
+  return threads;
+}
+
+// run a kernel, splitting very large arrays across several threads (the
+// kernels don't touch the R or Python APIs so can safely run off the main
+// thread), or queue it in 'batch'
+template <typename S, typename D>
+void run(void (*kernel)(const S*, D*, npy_intp), const void* data, D* dst, npy_intp n,
+         Batch* batch) {
+
+  const S* src = (const S*) data;
+
+  // queue in pieces (with their boundaries aligned for the SIMD loops, as
+  // kBatchChunk is a multiple of 64)
+  if (batch != NULL) {
+    for (npy_intp begin = 0; begin < n; begin += kBatchChunk) {
+      Batch::Task task;
+      task.invoke = invoke<S, D>;
+      task.kernel = (Batch::Kernel) kernel;
+      task.src = src + begin;
+      task.dst = dst + begin;
+      task.n = (n - begin < kBatchChunk) ? n - begin : kBatchChunk;
+      batch->add(task);
+    }
+    return;
+  }
+
+  npy_intp threads = 1;
+  if (n >= kParallelThreshold)
+    threads = thread_count(n);
+
+  if (threads <= 1) {
+    kernel(src, dst, n);
+    return;
+  }
+
+  // split into chunks (keeping chunk boundaries aligned for the SIMD loops)
+  npy_intp chunk = ((n / threads) + 63) & ~((npy_intp) 63);
+  std::vector< ConversionTask<S, D> > tasks(threads);
+  for (npy_intp i = 0; i < threads; i++) {
+    npy_intp begin = i * chunk;
+    npy_intp end = (i == threads - 1) ? n : begin + chunk;
+    tasks[i].kernel = kernel;
+    tasks[i].src = src + begin;
+    tasks[i].dst = dst + begin;
+    tasks[i].n = end - begin;
+  }
+
+  worker_pool().run(ConversionTask<S, D>::run, &tasks[0], threads, threads - 1);
+}
+
+// run one of the queued conversions of a batch
+void run_batch_task(void* data, std::size_t item) {
+  Batch::Task& task = ((Batch::Task*) data)[item];
+  task.invoke(task.kernel, task.src, task.dst, task.n);
+}
+
+} // anonymous namespace
+
+Batch::~Batch() {
+  for (std::size_t i = 0; i < retained_.size(); i++)
+    Py_DecRef(retained_[i]);
+}
+
+void Batch::retain(PyObject* object) {
+  Py_IncRef(object);
+  retained_.push_back(object);
+}
+
+void Batch::run() {
+
+  if (tasks_.empty())
+    return;
+
+  npy_intp n = 0;
+  for (std::size_t i = 0; i < tasks_.size(); i++)
+    n += tasks_[i].n;
+
+  npy_intp threads = thread_count(n);
+  if (threads > (npy_intp) tasks_.size())
+    threads = tasks_.size();
+
+  if (threads <= 1) {
+    for (std::size_t i = 0; i < tasks_.size(); i++)
+      run_batch_task(&tasks_[0], i);
+  } else {
+    worker_pool().run(run_batch_task, &tasks_[0], tasks_.size(), threads - 1);
+  }
+
+  tasks_.clear();
+}
+
+bool supports_integer(int typenum) {
+  switch (typenum) {
+  case NPY_BYTE:
+  case NPY_UBYTE:
+  case NPY_SHORT:
+  case NPY_USHORT:
+    return true;
+  case NPY_INT:
+    return sizeof(int) == sizeof(int32_t);
+  case NPY_LONG:
+    return sizeof(long) == sizeof(int32_t);
+  default:
+    return false;
+  }
+}
+
+bool supports_double(int typenum) {
+  switch (typenum) {
+  case NPY_INT:
+  case NPY_UINT:
+  case NPY_LONG:
+  case NPY_ULONG:
+  case NPY_LONGLONG:
+  case NPY_ULONGLONG:
+  case NPY_HALF:
+  case NPY_FLOAT:
+  case NPY_DOUBLE:
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool to_logical(int typenum, const void* data, int* result, npy_intp n,
+                Batch* batch) {
+  if (typenum != NPY_BOOL)
+    return false;
+  run<uint8_t, int>(uint8_to_int, data, result, n, batch);
+  return true;
+}
+
+bool to_integer(int typenum, const void* data, int* result, npy_intp n,
+                Batch* batch) {
+
+  switch (typenum) {
+  case NPY_BYTE:
+    run<int8_t, int>(int8_to_int, data, result, n, batch);
+    return true;
+  case NPY_UBYTE:
+    run<uint8_t, int>(uint8_to_int, data, result, n, batch);
+    return true;
+  case NPY_SHORT:
+    run<int16_t, int>(int16_to_int, data, result, n, batch);
+    return true;
+  case NPY_USHORT:
+    run<uint16_t, int>(uint16_to_int, data, result, n, batch);
+    return true;
+  case NPY_INT:
+    if (sizeof(int) != sizeof(int32_t))
+      return false;
+    run<int32_t, int>(copy_int, data, result, n, batch);
+    return true;
+  case NPY_LONG:
+    if (sizeof(long) != sizeof(int32_t))
+      return false;
+    run<int32_t, int>(copy_int, data, result, n, batch);
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool to_double(int typenum, const void* data, double* result, npy_intp n,
+               Batch* batch) {
+
+  switch (typenum) {
+  case NPY_INT:
+    run<int32_t, double>(int32_to_double, data, result, n, batch);
+    return true;
+  case NPY_UINT:
+    run<uint32_t, double>(uint32_to_double, data, result, n, batch);
+    return true;
+  case NPY_LONG:
+    if (sizeof(long) == sizeof(int64_t))
+      run<int64_t, double>(int64_to_double, data, result, n, batch);
+    else
+      run<int32_t, double>(int32_to_double, data, result, n, batch);
+    return true;
+  case NPY_ULONG:
+    if (sizeof(unsigned long) == sizeof(uint64_t))
+      run<uint64_t, double>(uint64_to_double, data, result, n, batch);
+    else
+      run<uint32_t, double>(uint32_to_double, data, result, n, batch);
+    return true;
+  case NPY_LONGLONG:
+    run<int64_t, double>(int64_to_double, data, result, n, batch);
+    return true;
+  case NPY_ULONGLONG:
+    run<uint64_t, double>(uint64_to_double, data, result, n, batch);
+    return true;
+  case NPY_HALF:
+    run<uint16_t, double>(half_to_double, data, result, n, batch);
+    return true;
+  case NPY_FLOAT:
+    run<float, double>(float_to_double, data, result, n, batch);
+    return true;
+  case NPY_DOUBLE:
+    run<double, double>(copy_double, data, result, n, batch);
+    return true;
+  default:
+    return false;
+  }
+}
+
+void to_logical_strided(const npy_bool* data,
+                        int nd,
+                        const npy_intp* shape,
+                        const npy_intp* strides,
+                        int* result) {
+
+  if (nd == 0) {
+    result[0] = data[0];
+    return;
+  }
+
+  // the first dimension varies fastest in the (fortran ordered) result
+  npy_intp inner = shape[0];
+  npy_intp innerStride = strides[0];
+  npy_intp outer = 1;
+  for (int d = 1; d < nd; d++)
+    outer *= shape[d];
+  if (inner == 0 || outer == 0)
+    return;
+
+  std::vector<npy_intp> index(nd, 0);
+  for (npy_intp k = 0; k < outer; k++) {
+
+    const char* src = (const char*) data;
+    for (int d = 1; d < nd; d++)
+      src += index[d] * strides[d];
+
+    for (npy_intp i = 0; i < inner; i++)
+      result[i] = *((const npy_bool*) (src + i * innerStride)) != 0;
+    result += inner;
+
+    for (int d = 1; d < nd; d++) {
+      if (++index[d] < shape[d])
+        break;
+      index[d] = 0;
+    }
+  }
+}
+
+void from_logical(const int* data, npy_bool* result, npy_intp n) {
+  run<int, npy_bool>(logical_to_bool, data, result, n, NULL);
+}
+
+void int64_to_double_na(const int64_t* data, double* result,
+                        npy_intp n, double divisor) {
+  const int64_t na = std::numeric_limits<int64_t>::min();
+  for (npy_intp i = 0; i < n; i++)
+    result[i] = data[i] == na ? NA_REAL : data[i] / divisor;
+}
+
+} // namespace kernels
@@ -0,0 +1,111 @@
+
+#ifndef __RETICULATE_KERNELS__
+#define __RETICULATE_KERNELS__
+
+#include "libpython.h"
+
+#include <stdint.h>
+
+#include <vector>
+
+// Conversion kernels which read the elements of a NumPy array directly from
+// its buffer and write them into the data of an R vector, widening them as
+// required (e.g. int16 -> integer, float32 -> double), and which pack R
+// logical vectors into NumPy booleans. The source data must be aligned, in
+// native byte order and contiguous.
+//
+// Where possible the kernels use SIMD instructions (AVX2 on x86, selected at
+// runtime, and NEON on 64-bit ARM), and very large arrays are converted in
+// parallel using a pool of worker threads (started on first use, and then
+// kept waiting for work rather than being started for each conversion).
+
+namespace kernels {
+
+// A batch of conversions (e.g. of the NumPy arrays in a list): conversions
+// given a batch are queued rather than run immediately, and the queued
+// conversions are then run together by run(), spread across the worker pool.
+// The destinations must remain allocated, and the sources alive (e.g. via
+// retain()), until the batch has been run. Batches are used on the main
+// thread only, with the GIL held.
+class Batch {
+public:
+
+  Batch() {}
+
+  // releases the retained objects (conversions which weren't run, e.g. when
+  // converting failed part way, are dropped)
+  ~Batch();
+
+  // keep an object (e.g. the array owning the source data) alive until the
+  // batch is destroyed
+  void retain(libpython::PyObject* object);
+
+  // run the queued conversions, returning once they're all done
+  void run();
+
+  // a queued conversion ('kernel' is the conversion function, called through
+  // 'invoke' with its actual type)
+  typedef void (*Kernel)();
+  struct Task {
+    void (*invoke)(Kernel kernel, const void* src, void* dst, libpython::npy_intp n);
+    Kernel kernel;
+    const void* src;
+    void* dst;
+    libpython::npy_intp n;
+  };
+
+  void add(const Task& task) {
+    tasks_.push_back(task);
+  }
+
+private:
+  Batch(const Batch&);
+  Batch& operator=(const Batch&);
+  std::vector<Task> tasks_;
+  std::vector<libpython::PyObject*> retained_;
+};
+
+// the conversions below are queued in 'batch' when one is given
+
+// convert 'n' elements of type 'typenum' to an R logical vector
+// (NPY_BOOL only); returns false if 'typenum' isn't supported
+bool to_logical(int typenum, const void* data, int* result, libpython::npy_intp n,
+                Batch* batch = NULL);
+
+// convert 'n' elements of type 'typenum' to an R integer vector (signed and
+// unsigned integers of up to 16 bits, and 32 bit signed integers); returns
+// false if 'typenum' isn't supported
+bool to_integer(int typenum, const void* data, int* result, libpython::npy_intp n,
+                Batch* batch = NULL);
+
+// convert 'n' elements of type 'typenum' to an R double vector (32 and 64
+// bit integers, and floating point values of up to 64 bits); returns false
+// if 'typenum' isn't supported
+bool to_double(int typenum, const void* data, double* result, libpython::npy_intp n,
+               Batch* batch = NULL);
+
+// whether to_integer() and to_double() support 'typenum' (so that callers
+// can check before allocating the result)
+bool supports_integer(int typenum);
+bool supports_double(int typenum);
+
+// convert a boolean array with an arbitrary layout (given by its shape and
+// strides, in bytes) to an R logical vector, in fortran order
+void to_logical_strided(const libpython::npy_bool* data,
+                        int nd,
+                        const libpython::npy_intp* shape,
+                        const libpython::npy_intp* strides,
+                        int* result);
+
+// pack the 'n' elements of an R logical vector into NumPy booleans (NA,
+// like any other non-zero value, becomes true)
+void from_logical(const int* data, libpython::npy_bool* result, libpython::npy_intp n);
+
+// convert 'n' 64-bit integers to doubles, dividing each by 'divisor' and
+// mapping the smallest 64-bit integer (e.g. NumPy's NaT) to NA
+void int64_to_double_na(const int64_t* data, double* result,
+                        libpython::npy_intp n, double divisor);
+
+} // namespace kernels
+
+#endif // __RETICULATE_KERNELS__
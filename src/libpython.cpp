@@ -156,6 +156,15 @@ if (!loadSymbol(pLib_, #name, (void**)&as, pError)) \
 if (!loadSymbol(pLib_, #name, (void**) &libpython::name, pError)) \
   return false;
 
+// load a symbol which isn't available in all Python versions (the function
+// pointer is set to NULL when the symbol is not found)
+#define LOAD_PYTHON_SYMBOL_OPTIONAL(name)                             \
+{                                                                     \
+  std::string ignored;                                                \
+  if (!loadSymbol(pLib_, #name, (void**) &libpython::name, &ignored)) \
+    libpython::name = NULL;                                           \
+}
+
 bool SharedLibrary::load(const std::string& libPath, bool python3, std::string* pError)
 {
   if (!loadLibrary(libPath, &pLib_, pError))
@@ -174,11 +183,15 @@ bool LibPython::loadSymbols(bool python3, std::string* pError)
   LOAD_PYTHON_SYMBOL(Py_AddPendingCall)
   LOAD_PYTHON_SYMBOL(PyErr_SetInterrupt)
   LOAD_PYTHON_SYMBOL(PyExc_KeyboardInterrupt)
+  LOAD_PYTHON_SYMBOL_AS(PyExc_RuntimeError, PyExc_RuntimeError_Ptr)
   LOAD_PYTHON_SYMBOL(Py_IncRef)
   LOAD_PYTHON_SYMBOL(Py_DecRef)
   LOAD_PYTHON_SYMBOL(PyObject_GetAttrString)
   LOAD_PYTHON_SYMBOL(PyObject_HasAttrString)
   LOAD_PYTHON_SYMBOL(PyObject_SetAttrString)
+  LOAD_PYTHON_SYMBOL(PyObject_GetAttr)
+  LOAD_PYTHON_SYMBOL(PyObject_HasAttr)
+  LOAD_PYTHON_SYMBOL(PyObject_SetAttr)
   LOAD_PYTHON_SYMBOL(PyTuple_Size)
   LOAD_PYTHON_SYMBOL(PyTuple_GetItem)
   LOAD_PYTHON_SYMBOL(PyTuple_New)
@@ -189,7 +202,10 @@ bool LibPython::loadSymbols(bool python3, std::string* pError)
   LOAD_PYTHON_SYMBOL(PyList_GetItem)
   LOAD_PYTHON_SYMBOL(PyList_SetItem)
   LOAD_PYTHON_SYMBOL(PyErr_Fetch)
+  LOAD_PYTHON_SYMBOL(PyErr_Restore)
   LOAD_PYTHON_SYMBOL(PyErr_Occurred)
+  LOAD_PYTHON_SYMBOL(PyErr_Clear)
+  LOAD_PYTHON_SYMBOL(PyErr_SetString)
   LOAD_PYTHON_SYMBOL(PyErr_NormalizeException)
   LOAD_PYTHON_SYMBOL(PyErr_ExceptionMatches)
   LOAD_PYTHON_SYMBOL(PyErr_GivenExceptionMatches)
@@ -198,6 +214,8 @@ bool LibPython::loadSymbols(bool python3, std::string* pError)
   LOAD_PYTHON_SYMBOL(PyByteArray_Size)
   LOAD_PYTHON_SYMBOL(PyByteArray_FromStringAndSize)
   LOAD_PYTHON_SYMBOL(PyByteArray_AsString)
+  LOAD_PYTHON_SYMBOL(PyObject_GetBuffer)
+  LOAD_PYTHON_SYMBOL(PyBuffer_Release)
   LOAD_PYTHON_SYMBOL(PyCallable_Check)
   LOAD_PYTHON_SYMBOL(PyRun_StringFlags)
   LOAD_PYTHON_SYMBOL(Py_CompileString)
@@ -211,10 +229,12 @@ bool LibPython::loadSymbols(bool python3, std::string* pError)
   LOAD_PYTHON_SYMBOL(PyIter_Next)
   LOAD_PYTHON_SYMBOL(PyLong_AsLong)
   LOAD_PYTHON_SYMBOL(PyLong_FromLong)
+  LOAD_PYTHON_SYMBOL(PyLong_FromVoidPtr)
   LOAD_PYTHON_SYMBOL(PyBool_FromLong)
   LOAD_PYTHON_SYMBOL(PyDict_New)
   LOAD_PYTHON_SYMBOL(PyDict_Contains)
   LOAD_PYTHON_SYMBOL(PyDict_GetItem)
+  LOAD_PYTHON_SYMBOL(PyDict_GetItemString)
   LOAD_PYTHON_SYMBOL(PyDict_SetItem)
   LOAD_PYTHON_SYMBOL(PyDict_SetItemString)
   LOAD_PYTHON_SYMBOL(PyDict_Next)
@@ -241,6 +261,15 @@ bool LibPython::loadSymbols(bool python3, std::string* pError)
   LOAD_PYTHON_SYMBOL(PyGILState_Ensure)
   LOAD_PYTHON_SYMBOL(PyGILState_Release)
   LOAD_PYTHON_SYMBOL(PyThreadState_Next)
+  LOAD_PYTHON_SYMBOL(PyInterpreterState_Head)
+  LOAD_PYTHON_SYMBOL(PyInterpreterState_ThreadHead)
+  LOAD_PYTHON_SYMBOL_OPTIONAL(PyThreadState_GetFrame)
+  LOAD_PYTHON_SYMBOL_OPTIONAL(PyFrame_GetBack)
+  LOAD_PYTHON_SYMBOL_OPTIONAL(PyFrame_GetCode)
+  LOAD_PYTHON_SYMBOL(PyEval_SaveThread)
+  LOAD_PYTHON_SYMBOL(PyEval_RestoreThread)
+  // PyEval_InitThreads is a no-op (and deprecated) as of Python 3.7
+  LOAD_PYTHON_SYMBOL_OPTIONAL(PyEval_InitThreads)
 
   // PyUnicode_AsEncodedString may have several different names depending on the Python
   // version and the UCS build type
@@ -264,8 +293,12 @@ bool LibPython::loadSymbols(bool python3, std::string* pError)
     LOAD_PYTHON_SYMBOL(PyBytes_AsStringAndSize)
     LOAD_PYTHON_SYMBOL(PyBytes_FromStringAndSize)
     LOAD_PYTHON_SYMBOL(PyUnicode_FromString)
+    LOAD_PYTHON_SYMBOL_AS(PyUnicode_InternFromString, PyString_InternFromString)
     LOAD_PYTHON_SYMBOL_AS(PyLong_AsLong, PyInt_AsLong)
     LOAD_PYTHON_SYMBOL_AS(PyLong_FromLong, PyInt_FromLong)
+    LOAD_PYTHON_SYMBOL_OPTIONAL(PyObject_Vectorcall)
+    LOAD_PYTHON_SYMBOL_OPTIONAL(PyObject_LengthHint)
+    LOAD_PYTHON_SYMBOL_OPTIONAL(PyUnicode_AsUTF8AndSize)
   } else {
     if (is64bit) {
       LOAD_PYTHON_SYMBOL_AS(Py_InitModule4_64, Py_InitModule4)
@@ -275,6 +308,7 @@ bool LibPython::loadSymbols(bool python3, std::string* pError)
     LOAD_PYTHON_SYMBOL(PyString_AsStringAndSize)
     LOAD_PYTHON_SYMBOL(PyString_FromStringAndSize)
     LOAD_PYTHON_SYMBOL(PyString_FromString)
+    LOAD_PYTHON_SYMBOL(PyString_InternFromString)
     LOAD_PYTHON_SYMBOL(Py_SetProgramName)
     LOAD_PYTHON_SYMBOL(Py_SetPythonHome)
     LOAD_PYTHON_SYMBOL(PySys_SetArgv)
@@ -347,6 +381,61 @@ bool import_numpy_api(bool python3, std::string* pError) {
   return true;
 }
 
+namespace {
+
+// node of the (lock-free) stack of deferred references
+struct DeferredDecRef {
+  PyObject* object;
+  DeferredDecRef* next;
+};
+
+DeferredDecRef* volatile s_deferredDecRefs = NULL;
+
+int release_deferred_decrefs_pending(void*) {
+  release_deferred_decrefs();
+  return 0;
+}
+
+} // anonymous namespace
+
+void decref_deferred(PyObject* object) {
+
+  DeferredDecRef* node = new DeferredDecRef();
+  node->object = object;
+
+  DeferredDecRef* head;
+  do {
+    head = s_deferredDecRefs;
+    node->next = head;
+  } while (!__sync_bool_compare_and_swap(&s_deferredDecRefs, head, node));
+
+  // if this is the first reference in the batch, ask the interpreter to
+  // release the batch in case it's running (e.g. we're in a callback to R);
+  // otherwise it will be released when the GIL is next acquired
+  if (head == NULL)
+    Py_AddPendingCall(release_deferred_decrefs_pending, NULL);
+}
+
+bool have_deferred_decrefs() {
+  return s_deferredDecRefs != NULL;
+}
+
+void release_deferred_decrefs() {
+
+  // detach the batch (releasing references can run arbitrary code, which
+  // might itself queue further references)
+  DeferredDecRef* head;
+  do {
+    head = s_deferredDecRefs;
+  } while (!__sync_bool_compare_and_swap(&s_deferredDecRefs, head, (DeferredDecRef*) NULL));
+
+  while (head != NULL) {
+    DeferredDecRef* next = head->next;
+    Py_DecRef(head->object);
+    delete head;
+    head = next;
+  }
+}
 
 } // namespace libpython
 
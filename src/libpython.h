@@ -6,6 +6,8 @@
 #include <ostream>
 #include <stdint.h>
 
+#include "event_loop.h"
+
 #ifndef LIBPYTHON_CPP
 #define LIBPYTHON_EXTERN extern
 #else
@@ -45,12 +47,62 @@ struct _typeobject *ob_type;
 PyObject_HEAD                           \
   Py_ssize_t ob_size;
 
+// the type object layout (through tp_version_tag) is the same for Python 2.7
+// and Python 3 (slots whose meaning differs between versions are declared
+// as generic pointers and never accessed)
 typedef struct _typeobject {
 PyObject_VAR_HEAD
   const char *tp_name;
   Py_ssize_t tp_basicsize, tp_itemsize;
+  void *tp_dealloc;
+  void *tp_print;
+  void *tp_getattr;
+  void *tp_setattr;
+  void *tp_compare;
+  void *tp_repr;
+  void *tp_as_number;
+  void *tp_as_sequence;
+  void *tp_as_mapping;
+  void *tp_hash;
+  void *tp_call;
+  void *tp_str;
+  void *tp_getattro;
+  void *tp_setattro;
+  void *tp_as_buffer;
+  unsigned long tp_flags;
+  const char *tp_doc;
+  void *tp_traverse;
+  void *tp_clear;
+  void *tp_richcompare;
+  Py_ssize_t tp_weaklistoffset;
+  void *tp_iter;
+  void *tp_iternext;
+  void *tp_methods;
+  void *tp_members;
+  void *tp_getset;
+  struct _typeobject *tp_base;
+  void *tp_dict;
+  void *tp_descr_get;
+  void *tp_descr_set;
+  Py_ssize_t tp_dictoffset;
+  void *tp_init;
+  void *tp_alloc;
+  void *tp_new;
+  void *tp_free;
+  void *tp_is_gc;
+  void *tp_bases;
+  void *tp_mro;
+  void *tp_cache;
+  void *tp_subclasses;
+  void *tp_weaklist;
+  void *tp_del;
+  unsigned int tp_version_tag;
 } PyTypeObject;
 
+// set when tp_version_tag is valid (it is reset whenever the type, or one of
+// its bases, is modified)
+#define Py_TPFLAGS_VALID_VERSION_TAG (1UL << 19)
+
 typedef struct _object {
 PyObject_HEAD
 } PyObject;
@@ -123,6 +175,10 @@ LIBPYTHON_EXTERN PyObject* Py_Complex;
 LIBPYTHON_EXTERN PyObject* Py_ByteArray;
 LIBPYTHON_EXTERN PyObject* PyExc_KeyboardInterrupt;
 
+// (loaded as the address of the variable holding the exception type)
+LIBPYTHON_EXTERN PyObject** PyExc_RuntimeError_Ptr;
+#define PyExc_RuntimeError (*libpython::PyExc_RuntimeError_Ptr)
+
 void initialize_type_objects(bool python3);
 
 #define Py_TYPE(ob) (((PyObject*)(ob))->ob_type)
@@ -183,9 +239,17 @@ LIBPYTHON_EXTERN PyObject* (*PyObject_Call)(PyObject *callable_object,
 LIBPYTHON_EXTERN PyObject* (*PyObject_CallFunctionObjArgs)(PyObject *callable,
            ...);
 
+// vectorcall (exported as a function from Python 3.9; NULL if not available)
+#define PY_VECTORCALL_ARGUMENTS_OFFSET ((size_t)1 << (8 * sizeof(size_t) - 1))
+LIBPYTHON_EXTERN PyObject* (*PyObject_Vectorcall)(PyObject *callable,
+           PyObject *const *args, size_t nargsf, PyObject *kwnames);
+
 LIBPYTHON_EXTERN PyObject* (*PyObject_GetAttrString)(PyObject*, const char *);
 LIBPYTHON_EXTERN int (*PyObject_HasAttrString)(PyObject*, const char *);
 LIBPYTHON_EXTERN int (*PyObject_SetAttrString)(PyObject*, const char *, PyObject*);
+LIBPYTHON_EXTERN PyObject* (*PyObject_GetAttr)(PyObject*, PyObject*);
+LIBPYTHON_EXTERN int (*PyObject_HasAttr)(PyObject*, PyObject*);
+LIBPYTHON_EXTERN int (*PyObject_SetAttr)(PyObject*, PyObject*, PyObject*);
 
 LIBPYTHON_EXTERN Py_ssize_t (*PyTuple_Size)(PyObject *);
 LIBPYTHON_EXTERN PyObject* (*PyTuple_GetItem)(PyObject *, Py_ssize_t);
@@ -209,6 +273,9 @@ LIBPYTHON_EXTERN int (*PyString_AsStringAndSize)(
 LIBPYTHON_EXTERN PyObject* (*PyString_FromString)(const char *);
 LIBPYTHON_EXTERN PyObject* (*PyString_FromStringAndSize)(const char *, Py_ssize_t);
 
+// PyUnicode_InternFromString on Python 3
+LIBPYTHON_EXTERN PyObject* (*PyString_InternFromString)(const char *);
+
 LIBPYTHON_EXTERN PyObject* (*PyUnicode_EncodeLocale)(PyObject *unicode, const char *errors);
 LIBPYTHON_EXTERN PyObject* (*PyUnicode_AsEncodedString)(PyObject *unicode, const char *encoding, const char *errors);
 LIBPYTHON_EXTERN int (*PyBytes_AsStringAndSize)(
@@ -227,9 +294,41 @@ LIBPYTHON_EXTERN Py_ssize_t (*PyByteArray_Size)(PyObject *bytearray);
 LIBPYTHON_EXTERN PyObject* (*PyByteArray_FromStringAndSize)(const char *string, Py_ssize_t len);
 LIBPYTHON_EXTERN char* (*PyByteArray_AsString)(PyObject *bytearray);
 LIBPYTHON_EXTERN PyObject* (*PyUnicode_FromString)(const char *u);
+LIBPYTHON_EXTERN const char* (*PyUnicode_AsUTF8AndSize)(PyObject *unicode, Py_ssize_t *size);
+
+// buffer protocol. the layout below is that of Python 2.7, which has an
+// additional 'smalltable' member before 'internal'; the members we read
+// have the same offsets in Python 3 (which just won't use the extra space)
+typedef struct bufferinfo {
+  void *buf;
+  PyObject *obj;
+  Py_ssize_t len;
+  Py_ssize_t itemsize;
+  int readonly;
+  int ndim;
+  char *format;
+  Py_ssize_t *shape;
+  Py_ssize_t *strides;
+  Py_ssize_t *suboffsets;
+  Py_ssize_t smalltable[2];
+  void *internal;
+} Py_buffer;
+
+#define PyBUF_SIMPLE 0
+#define PyBUF_WRITABLE 0x0001
+#define PyBUF_FORMAT 0x0004
+#define PyBUF_ND 0x0008
+#define PyBUF_STRIDES (0x0010 | PyBUF_ND)
+#define PyBUF_F_CONTIGUOUS (0x0040 | PyBUF_STRIDES)
+
+LIBPYTHON_EXTERN int (*PyObject_GetBuffer)(PyObject *exporter, Py_buffer *view, int flags);
+LIBPYTHON_EXTERN void (*PyBuffer_Release)(Py_buffer *view);
 
 LIBPYTHON_EXTERN void (*PyErr_Fetch)(PyObject **, PyObject **, PyObject **);
+LIBPYTHON_EXTERN void (*PyErr_Restore)(PyObject *, PyObject *, PyObject *);
 LIBPYTHON_EXTERN PyObject* (*PyErr_Occurred)(void);
+LIBPYTHON_EXTERN void (*PyErr_Clear)(void);
+LIBPYTHON_EXTERN void (*PyErr_SetString)(PyObject *type, const char *message);
 LIBPYTHON_EXTERN void (*PyErr_NormalizeException)(PyObject**, PyObject**, PyObject**);
 LIBPYTHON_EXTERN int (*PyErr_GivenExceptionMatches)(PyObject *given, PyObject *exc);
 LIBPYTHON_EXTERN int (*PyErr_ExceptionMatches)(PyObject *exc);
@@ -246,6 +345,9 @@ LIBPYTHON_EXTERN PyObject* (*PyEval_EvalCode)(PyObject *co, PyObject *globals, P
 LIBPYTHON_EXTERN PyObject* (*PyObject_GetIter)(PyObject *);
 LIBPYTHON_EXTERN PyObject* (*PyIter_Next)(PyObject *);
 
+// available from Python 3.4 (NULL if not available)
+LIBPYTHON_EXTERN Py_ssize_t (*PyObject_LengthHint)(PyObject *o, Py_ssize_t defaultvalue);
+
 typedef void (*PyCapsule_Destructor)(PyObject *);
 LIBPYTHON_EXTERN PyObject* (*PyCapsule_New)(void *pointer, const char *name, PyCapsule_Destructor destructor);
 LIBPYTHON_EXTERN void* (*PyCapsule_GetPointer)(PyObject *capsule, const char *name);
@@ -256,6 +358,7 @@ LIBPYTHON_EXTERN int (*PyCapsule_SetContext)(PyObject *capsule, void *context);
 LIBPYTHON_EXTERN PyObject* (*PyDict_New)(void);
 LIBPYTHON_EXTERN int (*PyDict_Contains)(PyObject *mp, PyObject *key);
 LIBPYTHON_EXTERN PyObject* (*PyDict_GetItem)(PyObject *mp, PyObject *key);
+LIBPYTHON_EXTERN PyObject* (*PyDict_GetItemString)(PyObject *mp, const char *key);
 LIBPYTHON_EXTERN int (*PyDict_SetItem)(PyObject *mp, PyObject *key, PyObject *item);
 LIBPYTHON_EXTERN int (*PyDict_SetItemString)(PyObject *dp, const char *key, PyObject *item);
 LIBPYTHON_EXTERN int (*PyDict_Next)(
@@ -268,6 +371,7 @@ LIBPYTHON_EXTERN PyObject* (*PyDict_Copy)(PyObject *mp);
 LIBPYTHON_EXTERN PyObject* (*PyInt_FromLong)(long);
 LIBPYTHON_EXTERN long (*PyInt_AsLong)(PyObject *);
 LIBPYTHON_EXTERN PyObject* (*PyLong_FromLong)(long);
+LIBPYTHON_EXTERN PyObject* (*PyLong_FromVoidPtr)(void *p);
 LIBPYTHON_EXTERN long (*PyLong_AsLong)(PyObject *);
 
 LIBPYTHON_EXTERN PyObject* (*PyBool_FromLong)(long);
@@ -480,6 +584,23 @@ inline int PyArray_FLAGS(PyArrayObject *arr) {
   return ((PyArrayObject_fields *)arr)->flags;
 }
 
+inline PyArray_Descr* PyArray_DESCR(PyArrayObject *arr) {
+  return ((PyArrayObject_fields *)arr)->descr;
+}
+
+inline npy_intp* PyArray_STRIDES(PyArrayObject *arr) {
+  return ((PyArrayObject_fields *)arr)->strides;
+}
+
+inline int PyArray_ITEMSIZE(PyArrayObject *arr) {
+  return ((PyArrayObject_fields *)arr)->descr->elsize;
+}
+
+// NOTE: numpy normalizes native byte order to '=' so an explicit '<' or '>'
+// always implies a non-native (swapped) byte order
+#define PyArray_ISNOTSWAPPED(arr) (PyArray_DESCR(arr)->byteorder != '>' && \
+                                   PyArray_DESCR(arr)->byteorder != '<')
+
 #define PyArray_SIZE(m) PyArray_MultiplyList(PyArray_DIMS(m), PyArray_NDIM(m))
 
 #define PyArray_Check(o) PyObject_TypeCheck(o, &PyArray_Type)
@@ -667,6 +788,64 @@ LIBPYTHON_EXTERN PyThreadState* (*PyGILState_GetThisThreadState)(void);
 LIBPYTHON_EXTERN PyGILState_STATE (*PyGILState_Ensure)(void);
 LIBPYTHON_EXTERN void (*PyGILState_Release)(PyGILState_STATE);
 LIBPYTHON_EXTERN PyThreadState* (*PyThreadState_Next)(PyThreadState*);
+LIBPYTHON_EXTERN PyInterpreterState* (*PyInterpreterState_Head)(void);
+LIBPYTHON_EXTERN PyThreadState* (*PyInterpreterState_ThreadHead)(PyInterpreterState*);
+
+// frame accessors (Python 3.9+, NULL otherwise); these return new references
+LIBPYTHON_EXTERN PyFrameObject* (*PyThreadState_GetFrame)(PyThreadState*);
+LIBPYTHON_EXTERN PyFrameObject* (*PyFrame_GetBack)(PyFrameObject*);
+LIBPYTHON_EXTERN PyCodeObject* (*PyFrame_GetCode)(PyFrameObject*);
+LIBPYTHON_EXTERN void (*PyEval_InitThreads)(void);
+LIBPYTHON_EXTERN PyThreadState* (*PyEval_SaveThread)(void);
+LIBPYTHON_EXTERN void (*PyEval_RestoreThread)(PyThreadState*);
+
+// references released by R finalizers are queued (which doesn't require the
+// GIL, and keeps deallocation out of R's garbage collector) and then released
+// in batches with the GIL held: the next time a GILScope is entered, or from a
+// pending call if the interpreter is running when the first one is queued
+void decref_deferred(PyObject* object);
+bool have_deferred_decrefs();
+void release_deferred_decrefs(); // requires the GIL
+
+// acquire the GIL for the lifetime of the scope. this is reentrant (the GIL
+// may already be held by the current thread) and is a no-op if Python has
+// not yet been initialized. since any code run with the GIL may execute
+// Python code (properties, __str__, etc.), entering the scope also activates
+// event polling (see event_loop.cpp).
+class GILScope {
+public:
+  GILScope() : acquired_(Py_IsInitialized != NULL && Py_IsInitialized()) {
+    if (acquired_) {
+      state_ = PyGILState_Ensure();
+      if (have_deferred_decrefs())
+        release_deferred_decrefs();
+      event_loop::activate();
+    }
+  }
+  ~GILScope() {
+    if (acquired_)
+      PyGILState_Release(state_);
+  }
+private:
+  GILScope(const GILScope&);
+  GILScope& operator=(const GILScope&);
+  bool acquired_;
+  PyGILState_STATE state_;
+};
+
+// release the GIL (which must be held by the current thread) for the
+// lifetime of the scope, e.g. while running R code which doesn't need it
+class GILUnlocker {
+public:
+  GILUnlocker() : state_(PyEval_SaveThread()) {}
+  ~GILUnlocker() {
+    PyEval_RestoreThread(state_);
+  }
+private:
+  GILUnlocker(const GILUnlocker&);
+  GILUnlocker& operator=(const GILUnlocker&);
+  PyThreadState* state_;
+};
 
 /* End PyFrameObject */
 
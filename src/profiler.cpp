@@ -0,0 +1,462 @@
+
+// The sampling profiler behind py_profile_start() / py_profile_stop().
+//
+// A background thread wakes up every interval, acquires the GIL and walks
+// the frames of each Python thread. To keep the time the GIL is held to a
+// minimum, a sample only records ids for the code objects of its frames
+// (a code object is retained the first time it is seen, so that its address
+// can't be re-used while the profiler holds onto it), and no strings are
+// built or memory allocated other than for code objects which haven't been
+// seen before. Samples are written into a ring
+// buffer which is allocated up front, so that a long profile keeps the
+// most recent samples rather than growing without bound.
+//
+// R frames can't be sampled from a background thread, so instead the depth
+// of the Python stack is recorded on the main thread at each entry into
+// Python from R (see Boundary). Samples of the main thread refer to the
+// boundaries which were active when they were taken, and the R calls for
+// a boundary are only read (on the main thread) when it is left, and only
+// if it was sampled in the meantime. This happens with the GIL held, so it
+// is consistent with what the sampling thread sees, and allows samples of
+// the main thread to be reported as mixed stacks (R frames, then the Python
+// frames they called, then any R frames called back from Python, and so
+// on).
+//
+// Names for the code objects are resolved once sampling has stopped, and
+// the samples are reported as collapsed stacks (one line per unique stack,
+// with its number of samples), which is the input format for most flame
+// graph tools.
+
+#include "profiler.h"
+
+#include "libpython.h"
+using namespace libpython;
+
+#include "tinythread.h"
+using namespace tthread;
+
+#include <Rinternals.h>
+
+#include <map>
+
+namespace profiler {
+
+namespace {
+
+// maximum number of frames recorded per sample
+enum { kMaxFrames = 128 };
+
+// maximum depth of the Python stack walked per thread
+enum { kMaxWalk = 1024 };
+
+// maximum nesting of entries into Python from R
+enum { kMaxBoundaries = 64 };
+
+// maximum number of distinct R function names
+enum { kMaxRNames = 4096 };
+
+// frames are recorded as ids: an index into s_codes, (with the high bit set)
+// an index into s_rNames, or (with the next bit set) an index into
+// s_rStacks, for the R calls of a boundary. R names are kept across
+// profiles.
+const uint32_t kRFrame = 0x80000000u;
+const uint32_t kBoundaryFrame = 0x40000000u;
+const uint32_t kNoStack = 0xFFFFFFFFu;
+
+struct Code {
+  PyObject* code;
+  std::string name;
+};
+
+std::vector<Code> s_codes;
+std::map<PyObject*, uint32_t> s_codeIds;
+
+std::vector<std::string> s_rNames;
+std::map<std::string, uint32_t> s_rNameIds;
+
+// the R calls on the stack (as R name ids, the outermost first) at each
+// sampled boundary, read when the boundary is left
+struct RStack {
+  bool read;
+  std::vector<uint32_t> frames;
+};
+
+std::vector<RStack> s_rStacks;
+
+uint32_t kThreadFrame;   // root frame for threads other than the main thread
+uint32_t kOtherRFrame;   // R functions beyond kMaxRNames
+uint32_t kTruncatedFrame; // root frame for stacks which were truncated
+
+// ring buffer of samples: each occupies kMaxFrames + 1 entries (its length,
+// then its frames from the outermost to the innermost)
+std::vector<uint32_t> s_ring;
+uint64_t s_capacity = 0;
+uint64_t s_samples = 0;
+
+// entries into Python from R on the main thread. 'stack' is the index of
+// the boundary's R calls in s_rStacks, assigned when it is first sampled.
+struct BoundaryEntry {
+  int pythonDepth;
+  uint32_t stack;
+};
+
+BoundaryEntry s_boundaries[kMaxBoundaries];
+int s_boundaryDepth = 0;
+
+PyThreadState* s_mainThreadState = NULL;
+bool s_python3 = false;
+
+// R function returning the R calls on the stack (its own call is last)
+SEXP s_callsFunction = R_NilValue;
+
+int s_intervalMs = 10;
+thread* s_thread = NULL;
+volatile long s_active = 0;
+volatile long s_stopRequested = 0;
+
+uint32_t r_name_id(const std::string& name) {
+  std::map<std::string, uint32_t>::iterator it = s_rNameIds.find(name);
+  if (it != s_rNameIds.end())
+    return it->second;
+  if (s_rNames.size() >= kMaxRNames)
+    return kOtherRFrame;
+  uint32_t id = kRFrame | (uint32_t) s_rNames.size();
+  s_rNames.push_back(name);
+  s_rNameIds[name] = id;
+  return id;
+}
+
+uint32_t code_id(PyObject* code) {
+  std::map<PyObject*, uint32_t>::iterator it = s_codeIds.find(code);
+  if (it != s_codeIds.end())
+    return it->second;
+  Py_IncRef(code);
+  Code entry;
+  entry.code = code;
+  uint32_t id = (uint32_t) s_codes.size();
+  s_codes.push_back(entry);
+  s_codeIds[code] = id;
+  return id;
+}
+
+// the thread state layouts used before frame accessors were available
+// (Python 3 added a 'prev' pointer before 'next')
+struct ThreadStateHead2 {
+  PyThreadState* next;
+  void* interp;
+  PyFrameObject* frame;
+};
+
+struct ThreadStateHead3 {
+  PyThreadState* prev;
+  PyThreadState* next;
+  void* interp;
+  PyFrameObject* frame;
+};
+
+// walk the Python frames of a thread from the innermost, storing up to
+// 'maxCodes' of their code objects (borrowed references which remain valid
+// while the GIL is held). returns the depth of the stack (up to kMaxWalk).
+int python_frames(PyThreadState* state, PyObject** codes, int maxCodes) {
+
+  int depth = 0;
+
+  if (PyThreadState_GetFrame != NULL && PyFrame_GetBack != NULL && PyFrame_GetCode != NULL) {
+
+    PyFrameObject* frame = PyThreadState_GetFrame(state);
+    while (frame != NULL && depth < kMaxWalk) {
+      if (depth < maxCodes) {
+        PyObject* code = (PyObject*) PyFrame_GetCode(frame);
+        codes[depth] = code;
+        Py_DecRef(code); // still referenced by the frame
+      }
+      depth++;
+      PyFrameObject* back = PyFrame_GetBack(frame);
+      Py_DecRef((PyObject*) frame);
+      frame = back;
+    }
+    if (frame != NULL)
+      Py_DecRef((PyObject*) frame);
+
+  } else {
+
+    PyFrameObject* frame = s_python3 ?
+      ((ThreadStateHead3*) state)->frame :
+      ((ThreadStateHead2*) state)->frame;
+
+    while (frame != NULL && depth < kMaxWalk) {
+      if (depth < maxCodes)
+        codes[depth] = (PyObject*) frame->f_code;
+      depth++;
+      frame = frame->f_back;
+    }
+  }
+
+  return depth;
+}
+
+// record a sample of one thread (requires the GIL)
+void sample_thread(PyThreadState* state) {
+
+  PyObject* codes[kMaxFrames];
+  int depth = python_frames(state, codes, kMaxFrames);
+  if (depth == 0)
+    return;
+
+  int recorded = depth < kMaxFrames ? depth : kMaxFrames;
+
+  uint32_t* sample = &s_ring[(s_samples % s_capacity) * (kMaxFrames + 1)];
+  uint32_t* frames = sample + 1;
+  int length = 0;
+
+#define PUSH_FRAME(id) if (length < kMaxFrames) frames[length++] = (id)
+
+  // frames deeper than we recorded are omitted from the root of the stack
+  int omitted = depth - recorded;
+  if (omitted > 0)
+    PUSH_FRAME(kTruncatedFrame);
+
+  // python frames between absolute depths [from, to) (outermost first)
+#define PUSH_PYTHON_FRAMES(from, to)                              \
+  for (int i = (from); i < (to); i++) {                           \
+    if (i >= omitted)                                             \
+      PUSH_FRAME(code_id(codes[depth - 1 - i]));                  \
+  }
+
+  int position = 0;
+  if (state == s_mainThreadState) {
+    int boundaries = s_boundaryDepth < kMaxBoundaries ? s_boundaryDepth : kMaxBoundaries;
+    for (int b = 0; b < boundaries; b++) {
+      BoundaryEntry& entry = s_boundaries[b];
+      int to = entry.pythonDepth < depth ? entry.pythonDepth : depth;
+      PUSH_PYTHON_FRAMES(position, to);
+      if (to > position)
+        position = to;
+      if (entry.stack == kNoStack) {
+        entry.stack = (uint32_t) s_rStacks.size();
+        s_rStacks.push_back(RStack());
+        s_rStacks.back().read = false;
+      }
+      PUSH_FRAME(kBoundaryFrame | entry.stack);
+    }
+  } else {
+    PUSH_FRAME(kThreadFrame);
+  }
+  PUSH_PYTHON_FRAMES(position, depth);
+
+#undef PUSH_PYTHON_FRAMES
+#undef PUSH_FRAME
+
+  sample[0] = length;
+  s_samples++;
+}
+
+void sample_threads() {
+  PyInterpreterState* interp = PyInterpreterState_Head();
+  if (interp == NULL)
+    return;
+  for (PyThreadState* state = PyInterpreterState_ThreadHead(interp);
+       state != NULL;
+       state = PyThreadState_Next(state)) {
+    sample_thread(state);
+  }
+}
+
+void sampler(void*) {
+  while (!s_stopRequested) {
+    this_thread::sleep_for(chrono::milliseconds(s_intervalMs));
+    if (s_stopRequested)
+      break;
+    PyGILState_STATE state = PyGILState_Ensure();
+    sample_threads();
+    PyGILState_Release(state);
+  }
+}
+
+// the name of the function called by an R call (e.g. 'f' or 'np$sum')
+std::string r_call_name(SEXP call) {
+
+  if (TYPEOF(call) != LANGSXP)
+    return "<anonymous>";
+
+  SEXP fun = CAR(call);
+  if (TYPEOF(fun) == SYMSXP)
+    return CHAR(PRINTNAME(fun));
+
+  // accessors such as x$f, x@f, pkg::f and pkg:::f
+  if (TYPEOF(fun) == LANGSXP && Rf_length(fun) == 3 && TYPEOF(CAR(fun)) == SYMSXP) {
+    std::string op = CHAR(PRINTNAME(CAR(fun)));
+    SEXP lhs = CADR(fun);
+    SEXP rhs = CADDR(fun);
+    if ((op == "$" || op == "@" || op == "::" || op == ":::") &&
+        TYPEOF(lhs) == SYMSXP && TYPEOF(rhs) == SYMSXP) {
+      return std::string(CHAR(PRINTNAME(lhs))) + op + CHAR(PRINTNAME(rhs));
+    }
+  }
+
+  return "<anonymous>";
+}
+
+} // anonymous namespace
+
+bool start(int intervalMs,
+           int maxSamples,
+           bool python3,
+           SEXP callsFunction,
+           std::string* pError) {
+
+  if (s_active) {
+    *pError = "the profiler is already running";
+    return false;
+  }
+
+  if (s_rNames.empty()) {
+    kThreadFrame = r_name_id("<thread>");
+    kOtherRFrame = r_name_id("<R>");
+    kTruncatedFrame = r_name_id("...");
+  }
+
+  s_python3 = python3;
+  s_callsFunction = callsFunction;
+  s_mainThreadState = PyGILState_GetThisThreadState();
+  s_intervalMs = intervalMs > 0 ? intervalMs : 1;
+  s_capacity = maxSamples > 0 ? maxSamples : 1;
+  s_ring.assign(s_capacity * (kMaxFrames + 1), 0);
+  s_samples = 0;
+
+  __sync_lock_test_and_set(&s_stopRequested, 0);
+  __sync_lock_test_and_set(&s_active, 1);
+  s_thread = new thread(sampler, NULL);
+  return true;
+}
+
+void stop() {
+  if (!s_active)
+    return;
+  __sync_lock_test_and_set(&s_stopRequested, 1);
+  s_thread->join();
+  delete s_thread;
+  s_thread = NULL;
+  __sync_lock_test_and_set(&s_active, 0);
+}
+
+bool active() {
+  return s_active != 0;
+}
+
+void collapse(std::string (*describe)(PyObject*),
+              std::vector<std::string>* pStacks,
+              std::vector<double>* pCounts,
+              uint64_t* pDropped) {
+
+  for (std::size_t i = 0; i < s_codes.size(); i++)
+    s_codes[i].name = describe(s_codes[i].code);
+
+  std::map<std::string, double> stacks;
+  uint64_t retained = s_samples < s_capacity ? s_samples : s_capacity;
+  for (uint64_t i = 0; i < retained; i++) {
+
+    const uint32_t* sample = &s_ring[i * (kMaxFrames + 1)];
+    std::string stack;
+
+    // each boundary adds the R calls made since the previous one
+    std::size_t rDepth = 0;
+    for (uint32_t j = 0; j < sample[0]; j++) {
+
+      uint32_t id = sample[j + 1];
+      if (id & kRFrame) {
+        if (!stack.empty())
+          stack += ';';
+        stack += s_rNames[id & ~kRFrame];
+      } else if (id & kBoundaryFrame) {
+        uint32_t index = id & ~kBoundaryFrame;
+        const std::vector<uint32_t>* calls =
+          index < s_rStacks.size() && s_rStacks[index].read ? &s_rStacks[index].frames : NULL;
+        if (calls == NULL) {
+          // the boundary was still active when sampling stopped
+          if (!stack.empty())
+            stack += ';';
+          stack += s_rNames[kOtherRFrame & ~kRFrame];
+          continue;
+        }
+        for (std::size_t k = rDepth; k < calls->size(); k++) {
+          if (!stack.empty())
+            stack += ';';
+          stack += s_rNames[(*calls)[k] & ~kRFrame];
+        }
+        if (calls->size() > rDepth)
+          rDepth = calls->size();
+      } else {
+        if (!stack.empty())
+          stack += ';';
+        stack += s_codes[id].name;
+      }
+    }
+
+    stacks[stack] += 1;
+  }
+
+  for (std::map<std::string, double>::const_iterator it = stacks.begin(); it != stacks.end(); ++it) {
+    pStacks->push_back(it->first);
+    pCounts->push_back(it->second);
+  }
+  *pDropped = s_samples - retained;
+
+  // release the samples and the code objects they referenced
+  for (std::size_t i = 0; i < s_codes.size(); i++)
+    Py_DecRef(s_codes[i].code);
+  s_codes.clear();
+  s_codeIds.clear();
+  s_rStacks.clear();
+  for (int b = 0; b < kMaxBoundaries; b++)
+    s_boundaries[b].stack = kNoStack;
+  std::vector<uint32_t>().swap(s_ring);
+  s_capacity = 0;
+  s_samples = 0;
+}
+
+void Boundary::enter() {
+
+  int depth = s_boundaryDepth++;
+  if (depth >= kMaxBoundaries)
+    return;
+
+  PyThreadState* state = PyGILState_GetThisThreadState();
+  BoundaryEntry& entry = s_boundaries[depth];
+  entry.pythonDepth = state == s_mainThreadState ? python_frames(state, NULL, 0) : 0;
+  entry.stack = kNoStack;
+}
+
+void Boundary::leave() {
+
+  if (s_boundaryDepth == 0)
+    return;
+
+  int depth = --s_boundaryDepth;
+  if (depth >= kMaxBoundaries)
+    return;
+
+  // read the R calls for a boundary which was sampled (omitting the call
+  // to s_callsFunction itself). these are the same as when it was entered.
+  // this runs from the Boundary destructor (possibly while an exception
+  // unwinds), so an R error or interrupt mustn't longjmp from here: the
+  // stack is just left unread if the calls can't be read.
+  BoundaryEntry& entry = s_boundaries[depth];
+  if (entry.stack == kNoStack || entry.stack >= s_rStacks.size())
+    return;
+
+  RStack& stack = s_rStacks[entry.stack];
+  entry.stack = kNoStack;
+
+  int error = 0;
+  SEXP callSEXP = PROTECT(Rf_lang1(s_callsFunction));
+  SEXP calls = PROTECT(R_tryEvalSilent(callSEXP, R_GlobalEnv, &error));
+  if (!error) {
+    for (SEXP call = calls; call != R_NilValue && CDR(call) != R_NilValue; call = CDR(call))
+      stack.frames.push_back(r_name_id(r_call_name(CAR(call))));
+    stack.read = true;
+  }
+  UNPROTECT(2);
+}
+
+} // namespace profiler
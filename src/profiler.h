@@ -0,0 +1,73 @@
+
+#ifndef __RETICULATE_PROFILER__
+#define __RETICULATE_PROFILER__
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <Rinternals.h>
+
+#include "libpython.h"
+
+// A sampling profiler for Python code run from R. A background thread
+// periodically acquires the GIL, records the Python frames of each thread
+// (as references to their code objects) into a preallocated ring buffer,
+// and releases the GIL again; names are only resolved once sampling has
+// stopped. For the main thread, the R calls which led into Python are
+// recorded at each entry from R (see Boundary) so that samples can be
+// reported as mixed R / Python stacks.
+
+namespace profiler {
+
+// start sampling every 'intervalMs' milliseconds, keeping the most recent
+// 'maxSamples' samples. 'callsFunction' is an R function returning the R
+// calls on the stack (as sys.calls() does, including its own call). requires
+// the GIL (and must be called from the main thread).
+bool start(int intervalMs,
+           int maxSamples,
+           bool python3,
+           SEXP callsFunction,
+           std::string* pError);
+
+// stop sampling. must be called without the GIL held (the sampling thread
+// may be waiting for it).
+void stop();
+
+// is the profiler sampling?
+bool active();
+
+// the samples recorded so far, as collapsed stacks (frames from the
+// outermost to the innermost, separated by semicolons) with the number of
+// samples for each; 'dropped' is the number of samples overwritten in the
+// ring buffer. Python frames are named by 'describe' (given a code object).
+// requires the GIL, and releases the samples.
+void collapse(std::string (*describe)(libpython::PyObject*),
+              std::vector<std::string>* pStacks,
+              std::vector<double>* pCounts,
+              uint64_t* pDropped);
+
+// mark an entry into Python from R for the lifetime of the scope (a no-op
+// unless the profiler is active). requires the GIL.
+class Boundary {
+public:
+  Boundary() : entered_(active()) {
+    if (entered_)
+      enter();
+  }
+  ~Boundary() {
+    if (entered_)
+      leave();
+  }
+private:
+  Boundary(const Boundary&);
+  Boundary& operator=(const Boundary&);
+  static void enter();
+  static void leave();
+  bool entered_;
+};
+
+} // namespace profiler
+
+#endif // __RETICULATE_PROFILER__
@@ -6,12 +6,24 @@ using namespace Rcpp;
 
 #include "reticulate_types.h"
 
+#include "altrep.h"
+#include "arrow.h"
 #include "event_loop.h"
-#include "tinythread.h"
+#include "kernels.h"
+#include "profiler.h"
+#include "stats.h"
 
+#include <cmath>
+#include <cstring>
 #include <fstream>
+#include <limits>
+#include <list>
+#include <map>
+#include <set>
 #include <time.h>
 
+#include <sys/stat.h>
+
 using namespace libpython;
 
 // track whether we are using python 3 (set during py_initialize)
@@ -28,24 +40,44 @@ bool is_interactive() {
   return s_isInteractive;
 }
 
-// track whether we have required numpy
+// track whether we have required numpy. the NumPy C API is bound on first use
+// rather than at initialization (importing numpy is slow, and many sessions
+// never use it): haveNumPy() and requireNumPy() bind it, whereas the checks
+// for arrays only do so once numpy has been imported by someone else (until
+// then no object can be an array).
 std::string s_numpy_load_error;
-bool haveNumPy() {
+bool s_numpy_resolved = false;
+bool resolveNumPy() {
+  if (!s_numpy_resolved) {
+    s_numpy_resolved = true;
+    if (s_numpy_load_error.empty() && !import_numpy_api(is_python3(), &s_numpy_load_error))
+      PyErr_Clear();
+  }
   return s_numpy_load_error.empty();
 }
+bool numpyImported() {
+  return PyDict_GetItemString(PyImport_GetModuleDict(), "numpy") != NULL;
+}
+bool haveNumPy() {
+  return resolveNumPy();
+}
 bool requireNumPy() {
   if (!haveNumPy())
     stop("Required version of NumPy not available: " + s_numpy_load_error);
   return true;
 }
 bool isPyArray(PyObject* object) {
-  if (!haveNumPy())
+  if (!s_numpy_resolved && !numpyImported())
+    return false;
+  else if (!resolveNumPy())
     return false;
   else
     return PyArray_Check(object);
 }
 bool isPyArrayScalar(PyObject* object) {
-  if (!haveNumPy())
+  if (!s_numpy_resolved && !numpyImported())
+    return false;
+  else if (!resolveNumPy())
     return false;
   else
     return PyArray_CheckScalar(object);
@@ -57,6 +89,42 @@ std::wstring s_python_v3;
 std::string s_pythonhome;
 std::wstring s_pythonhome_v3;
 
+// handles to R functions which we call frequently. these are resolved once
+// (when Python is initialized) and preserved for the rest of the session so
+// we don't need to look them up by name on every call.
+SEXP s_r_to_py_fn = NULL;
+SEXP s_py_to_r_fn = NULL;
+SEXP s_py_filter_classes_fn = NULL;
+SEXP s_py_callable_as_function_fn = NULL;
+SEXP s_traceback_enabled_fn = NULL;
+SEXP s_do_call_fn = NULL;
+SEXP s_append_fn = NULL;
+SEXP s_profile_calls_fn = NULL;
+SEXP s_py_lazy_dict_fn = NULL;
+
+SEXP resolve_r_function(SEXP env, const char* name) {
+  SEXP fn = Rf_findFun(Rf_install(name), env);
+  R_PreserveObject(fn);
+  return fn;
+}
+
+void initialize_r_functions() {
+
+  if (s_r_to_py_fn != NULL)
+    return;
+
+  Environment pkgEnv = Environment::namespace_env("reticulate");
+  s_r_to_py_fn = resolve_r_function(pkgEnv, "r_to_py");
+  s_py_to_r_fn = resolve_r_function(pkgEnv, "py_to_r");
+  s_py_filter_classes_fn = resolve_r_function(pkgEnv, "py_filter_classes");
+  s_py_callable_as_function_fn = resolve_r_function(pkgEnv, "py_callable_as_function");
+  s_traceback_enabled_fn = resolve_r_function(pkgEnv, "traceback_enabled");
+  s_profile_calls_fn = resolve_r_function(pkgEnv, "profile_calls");
+  s_py_lazy_dict_fn = resolve_r_function(pkgEnv, "py_lazy_dict");
+  s_do_call_fn = resolve_r_function(R_BaseEnv, "do.call");
+  s_append_fn = resolve_r_function(R_BaseEnv, "append");
+}
+
 
 
 // helper to convert std::string to std::wstring
@@ -126,6 +194,29 @@ private:
 typedef PyPtr<PyObject> PyObjectPtr;
 typedef PyPtr<PyArray_Descr> PyArray_DescrPtr;
 
+// vector of PyObjects which we own references to (we decref on destruction)
+class PyObjectVector {
+public:
+  explicit PyObjectVector(std::size_t n) : objects_(n, (PyObject*) NULL) {}
+  ~PyObjectVector() {
+    for (std::size_t i = 0; i < objects_.size(); i++) {
+      if (objects_[i] != NULL)
+        Py_DecRef(objects_[i]);
+    }
+  }
+
+  PyObject*& operator[](std::size_t i) { return objects_[i]; }
+
+  PyObject** data() { return objects_.empty() ? NULL : &objects_[0]; }
+
+private:
+  // prevent copying
+  PyObjectVector(const PyObjectVector&);
+  PyObjectVector& operator=(const PyObjectVector&);
+
+  std::vector<PyObject*> objects_;
+};
+
 PyObject* PyUnicode_AsBytes(PyObject* str) {
   return PyUnicode_AsEncodedString(str, "utf-8", "ignore");
 }
@@ -174,6 +265,125 @@ PyObject* as_python_str(const std::string& str) {
   }
 }
 
+// cache of the Python strings created for R strings (CHARSXPs), keyed on the
+// address of the CHARSXP: R caches its strings, so the repeated values of a
+// character vector (e.g. the levels of a factor) are the same CHARSXP, and
+// each is only converted once. direct mapped (a collision just replaces the
+// entry), and holds a reference to each of its strings. the CHARSXPs must
+// remain valid for the lifetime of the cache (as they do when they belong to
+// the vector being converted), unless the cache is 'anchored', in which case
+// it keeps them alive itself (used for the session wide cache). the cache is
+// sized by reserve(), and until then just creates a new string each time.
+class PyStrCache {
+
+public:
+
+  // vectors shorter than kMinLength aren't worth caching, and the cache has
+  // at most kMaxSlots entries
+  enum { kMinLength = 32, kMaxSlots = 1024 };
+
+  explicit PyStrCache(bool anchored = false)
+    : mask_(0), anchored_(anchored), anchor_(R_NilValue) {}
+
+  ~PyStrCache() {
+    clear();
+    if (anchor_ != R_NilValue)
+      R_ReleaseObject(anchor_);
+  }
+
+  // size the (empty) cache for converting 'n' strings
+  void reserve(R_xlen_t n) {
+
+    if (!entries_.empty() || n < kMinLength)
+      return;
+
+    std::size_t slots = kMinLength;
+    while (slots < (std::size_t) n && slots < (std::size_t) kMaxSlots)
+      slots <<= 1;
+
+    Entry empty = { NULL, NULL };
+    entries_.assign(slots, empty);
+    mask_ = slots - 1;
+
+    if (anchored_) {
+      anchor_ = Rf_allocVector(STRSXP, slots);
+      R_PreserveObject(anchor_);
+    }
+  }
+
+  // a new reference to the Python string for 'charsxp' (NULL on error)
+  PyObject* get(SEXP charsxp) {
+
+    if (entries_.empty())
+      return as_python_str(charsxp);
+
+    std::size_t index = slot(charsxp);
+    Entry& entry = entries_[index];
+    if (entry.charsxp != charsxp) {
+      PyObject* str = as_python_str(charsxp);
+      if (str == NULL)
+        return NULL;
+      if (entry.str != NULL)
+        Py_DecRef(entry.str);
+      entry.charsxp = charsxp;
+      entry.str = str;
+      if (anchor_ != R_NilValue)
+        SET_STRING_ELT(anchor_, index, charsxp);
+    }
+
+    Py_IncRef(entry.str);
+    return entry.str;
+  }
+
+  void clear() {
+    for (std::size_t i = 0; i < entries_.size(); i++) {
+      if (entries_[i].str != NULL)
+        Py_DecRef(entries_[i].str);
+      entries_[i].charsxp = NULL;
+      entries_[i].str = NULL;
+    }
+  }
+
+private:
+
+  PyStrCache(const PyStrCache&);
+  PyStrCache& operator=(const PyStrCache&);
+
+  struct Entry {
+    SEXP charsxp;
+    PyObject* str;
+  };
+
+  std::size_t slot(SEXP charsxp) const {
+    std::size_t value = (std::size_t) charsxp;
+    return ((value >> 4) ^ (value >> 14)) & mask_;
+  }
+
+  std::vector<Entry> entries_;
+  std::size_t mask_;
+  bool anchored_;
+  SEXP anchor_;
+};
+
+// with reticulate.string_cache set, strings are cached across conversions
+// for the rest of the session (rather than for a single conversion)
+PyStrCache* s_session_str_cache = NULL;
+
+// the cache to use for converting a character vector of length 'n': the
+// session wide cache when enabled, and otherwise 'local' (sized for 'n')
+PyStrCache& str_cache(PyStrCache& local, R_xlen_t n) {
+  SEXP option = Rf_GetOption(Rf_install("reticulate.string_cache"), R_BaseEnv);
+  if (!(Rf_isLogical(option) && Rf_length(option) == 1 && LOGICAL(option)[0] == TRUE)) {
+    local.reserve(n);
+    return local;
+  }
+  if (s_session_str_cache == NULL) {
+    s_session_str_cache = new PyStrCache(true);
+    s_session_str_cache->reserve(PyStrCache::kMaxSlots);
+  }
+  return *s_session_str_cache;
+}
+
 bool has_null_bytes(PyObject* str) {
   char* buffer;
   int res = PyString_AsStringAndSize(str, &buffer, NULL);
@@ -245,6 +455,28 @@ int narrow_array_typenum(PyArray_Descr* descr) {
   return narrow_array_typenum(descr->type_num);
 }
 
+// check whether a numpy type is a (native) 32 bit integer, which can be
+// copied directly into an R integer vector
+bool is_int32_typenum(int typenum) {
+  if (typenum == NPY_INT)
+    return sizeof(int) == 4;
+  else if (typenum == NPY_LONG)
+    return sizeof(long) == 4;
+  else
+    return false;
+}
+
+// check whether an array already has the requested type and is laid out in
+// (aligned, native byte order) fortran order, so that its data can be read
+// without first casting it with PyArray_CastToType
+bool is_farray_of_type(PyArrayObject* array, int typenum) {
+  int flags = PyArray_FLAGS(array);
+  return PyArray_TYPE(array) == typenum &&
+         (flags & NPY_ARRAY_F_CONTIGUOUS) &&
+         (flags & NPY_ARRAY_ALIGNED) &&
+         PyArray_ISNOTSWAPPED(array);
+}
+
 bool is_numpy_str(PyObject* x) {
   if (!isPyArrayScalar(x))
     return false; // ndarray or other, not string
@@ -303,11 +535,8 @@ std::string as_r_class(PyObject* classPtr) {
   return ostr.str();
 }
 
-// wrap a PyObject
-PyObjectRef py_ref(PyObject* object, bool convert, const std::string& extraClass = "") {
-
-  // wrap
-  PyObjectRef ref(object, convert);
+// compute the (filtered) R class attribute for a PyObject
+CharacterVector py_class_names(PyObject* object, const std::string& extraClass) {
 
   // class attribute
   std::vector<std::string> attrClass;
@@ -351,12 +580,90 @@ PyObjectRef py_ref(PyObject* object, bool convert, const std::string& extraClass
   }
 
   // apply class filter
-  Rcpp::Environment pkgEnv = Rcpp::Environment::namespace_env("reticulate");
-  Rcpp::Function py_filter_classes = pkgEnv["py_filter_classes"];
-  attrClass = as<std::vector<std::string> >(py_filter_classes(attrClass));
+  Rcpp::Function py_filter_classes(s_py_filter_classes_fn);
+  return py_filter_classes(attrClass);
+}
+
+#ifndef MARK_NOT_MUTABLE
+# define MARK_NOT_MUTABLE(x) SET_NAMED(x, 2)
+#endif
+
+// cache of R class attributes, keyed on the Python type (and the extra class
+// requested by the caller). entries are validated against the type's version
+// tag, which Python resets whenever the type or one of its bases is modified
+// (this also protects us against a type being freed and its address reused).
+// the cache is cleared whenever the set of registered class filters changes.
+struct ClassCacheEntry {
+  unsigned int version_tag;
+  SEXP classes;
+};
+typedef std::pair<PyTypeObject*, std::string> ClassCacheKey;
+typedef std::map<ClassCacheKey, ClassCacheEntry> ClassCache;
+ClassCache s_class_cache;
+
+// incremented whenever the class cache is cleared, so that attribute handles
+// created with the previous classes are invalidated (see py_get_attr_cached)
+int s_class_cache_generation = 0;
+
+// [[Rcpp::export]]
+void py_class_cache_clear() {
+  s_class_cache_generation++;
+  for (ClassCache::iterator it = s_class_cache.begin();
+       it != s_class_cache.end();
+       ++it)
+  {
+    R_ReleaseObject(it->second.classes);
+  }
+  s_class_cache.clear();
+}
+
+SEXP py_class_names_cached(PyObject* object, const std::string& extraClass) {
+
+  PyTypeObject* type = Py_TYPE(object);
+  bool valid = (type->tp_flags & Py_TPFLAGS_VALID_VERSION_TAG) != 0;
+
+  // check for a cached entry
+  ClassCacheKey key(type, extraClass);
+  ClassCache::iterator it = s_class_cache.find(key);
+  if (it != s_class_cache.end()) {
+    if (valid && it->second.version_tag == type->tp_version_tag)
+      return it->second.classes;
+    R_ReleaseObject(it->second.classes);
+    s_class_cache.erase(it);
+  }
+
+  CharacterVector classes = py_class_names(object, extraClass);
+
+  // re-read the flag as computing the classes will typically have assigned
+  // a version tag to the type. we only cache when '__class__' is the type
+  // itself (proxy objects may report some other class).
+  valid = (type->tp_flags & Py_TPFLAGS_VALID_VERSION_TAG) != 0;
+  if (valid) {
+    PyObjectPtr classPtr(PyObject_GetAttrString(object, "__class__"));
+    if (classPtr.is_null())
+      PyErr_Clear();
+    else if (classPtr.get() == (PyObject*) type) {
+      // the vector is shared between objects so it must never be modified
+      MARK_NOT_MUTABLE(classes);
+      R_PreserveObject(classes);
+      ClassCacheEntry entry;
+      entry.version_tag = type->tp_version_tag;
+      entry.classes = classes;
+      s_class_cache[key] = entry;
+    }
+  }
+
+  return classes;
+}
+
+// wrap a PyObject
+PyObjectRef py_ref(PyObject* object, bool convert, const std::string& extraClass = "") {
+
+  // wrap
+  PyObjectRef ref(object, convert);
 
   // set classes
-  ref.attr("class") = attrClass;
+  Rf_setAttrib(ref.get__(), R_ClassSymbol, py_class_names_cached(object, extraClass));
 
   // return ref
   return ref;
@@ -368,8 +675,7 @@ bool option_is_true(const std::string& name) {
 }
 
 bool traceback_enabled() {
-  Environment pkgEnv = Environment::namespace_env("reticulate");
-  Function func = pkgEnv["traceback_enabled"];
+  Function func(s_traceback_enabled_fn);
   return as<bool>(func());
 }
 
@@ -552,27 +858,6 @@ int r_scalar_type(PyObject* x) {
     return NILSXP;
 }
 
-// check whether the PyObject is a list of a single R scalar type
-int scalar_list_type(PyObject* x) {
-
-  Py_ssize_t len = PyList_Size(x);
-  if (len == 0)
-    return NILSXP;
-
-  PyObject* first = PyList_GetItem(x, 0);
-  int scalarType = r_scalar_type(first);
-  if (scalarType == NILSXP)
-    return NILSXP;
-
-  for (Py_ssize_t i = 1; i<len; i++) {
-    PyObject* next = PyList_GetItem(x, i);
-    if (r_scalar_type(next) != scalarType)
-      return NILSXP;
-  }
-
-  return scalarType;
-}
-
 // convert a tuple to a character vector
 CharacterVector py_tuple_to_character(PyObject* tuple) {
   Py_ssize_t len = PyTuple_Size(tuple);
@@ -582,11 +867,308 @@ CharacterVector py_tuple_to_character(PyObject* tuple) {
   return vec;
 }
 
-void set_string_element(SEXP rArray, int i, PyObject* pyStr) {
-  std::string str = as_std_string(pyStr);
-  cetype_t ce = PyUnicode_Check(pyStr) ? CE_UTF8 : CE_NATIVE;
-  SEXP strSEXP = Rf_mkCharCE(str.c_str(), ce);
-  SET_STRING_ELT(rArray, i, strSEXP);
+// small direct-mapped cache of recently created CHARSXPs, used when converting
+// arrays of strings (which frequently contain repeated values) so that repeated
+// values skip both decoding and the lookup in R's global CHARSXP cache. values
+// are keyed either by their raw (undecoded) bytes or by the Python object they
+// came from; the keys must remain valid, and the cached CHARSXPs must be kept
+// alive (e.g. by storing them in the vector being filled), for the lifetime
+// of the cache.
+class CharsxpCache {
+
+public:
+
+  CharsxpCache() {
+    std::memset(entries_, 0, sizeof(entries_));
+  }
+
+  SEXP lookup(const char* key, std::size_t size) const {
+    const Entry& entry = entries_[slot(hash(key, size))];
+    if (entry.charsxp != NULL && entry.size == size &&
+        (entry.key == key || std::memcmp(entry.key, key, size) == 0))
+      return entry.charsxp;
+    return NULL;
+  }
+
+  void insert(const char* key, std::size_t size, SEXP charsxp) {
+    Entry& entry = entries_[slot(hash(key, size))];
+    entry.key = key;
+    entry.size = size;
+    entry.charsxp = charsxp;
+  }
+
+  SEXP lookup(PyObject* object) const {
+    const Entry& entry = entries_[slot(hash(object))];
+    if (entry.charsxp != NULL && entry.size == kObjectKey && entry.key == (const char*) object)
+      return entry.charsxp;
+    return NULL;
+  }
+
+  void insert(PyObject* object, SEXP charsxp) {
+    Entry& entry = entries_[slot(hash(object))];
+    entry.key = (const char*) object;
+    entry.size = kObjectKey;
+    entry.charsxp = charsxp;
+  }
+
+private:
+
+  struct Entry {
+    const char* key;
+    std::size_t size;
+    SEXP charsxp;
+  };
+
+  enum { kSlots = 256 };
+  static const std::size_t kObjectKey = (std::size_t) -1;
+
+  static std::size_t slot(std::size_t hash) {
+    return hash & (kSlots - 1);
+  }
+
+  // FNV-1a
+  static std::size_t hash(const char* data, std::size_t size) {
+    uint32_t value = 2166136261u;
+    for (std::size_t i = 0; i < size; i++) {
+      value ^= (unsigned char) data[i];
+      value *= 16777619u;
+    }
+    return value;
+  }
+
+  static std::size_t hash(PyObject* object) {
+    std::size_t value = (std::size_t) object;
+    return (value >> 4) ^ (value >> 12);
+  }
+
+  Entry entries_[kSlots];
+};
+
+// append the UTF-8 encoding of a code point (invalid code points are dropped,
+// as with the 'ignore' error handler used by as_std_string)
+inline void append_utf8(std::string* buffer, uint32_t c) {
+  if (c < 0x80) {
+    buffer->push_back((char) c);
+  } else if (c < 0x800) {
+    buffer->push_back((char) (0xC0 | (c >> 6)));
+    buffer->push_back((char) (0x80 | (c & 0x3F)));
+  } else if (c < 0x10000) {
+    if (c >= 0xD800 && c <= 0xDFFF)
+      return;
+    buffer->push_back((char) (0xE0 | (c >> 12)));
+    buffer->push_back((char) (0x80 | ((c >> 6) & 0x3F)));
+    buffer->push_back((char) (0x80 | (c & 0x3F)));
+  } else if (c < 0x110000) {
+    buffer->push_back((char) (0xF0 | (c >> 18)));
+    buffer->push_back((char) (0x80 | ((c >> 12) & 0x3F)));
+    buffer->push_back((char) (0x80 | ((c >> 6) & 0x3F)));
+    buffer->push_back((char) (0x80 | (c & 0x3F)));
+  }
+}
+
+// convert the fixed width elements of a NumPy string (NPY_STRING) or unicode
+// (NPY_UNICODE, stored as UCS4) array to a character vector, reading the
+// array's buffer directly. the array must be aligned, in native byte order and
+// fortran contiguous. elements are truncated at their first null character
+// (which also trims the padding of shorter values).
+SEXP numpy_strings_to_r(PyArrayObject* array, const IntegerVector& dims, int typenum) {
+
+  npy_intp len = PyArray_SIZE(array);
+  std::size_t itemsize = PyArray_ITEMSIZE(array);
+  const char* data = (const char*) PyArray_DATA(array);
+
+  RObject rArray(Rf_allocArray(STRSXP, dims));
+  CharsxpCache cache;
+  std::string buffer;
+
+  for (npy_intp i = 0; i < len; i++) {
+
+    const char* item = data + i * itemsize;
+
+    // find the length of the value (in bytes of the raw item)
+    std::size_t size = 0;
+    if (typenum == NPY_UNICODE) {
+      const uint32_t* chars = (const uint32_t*) item;
+      std::size_t n = itemsize / sizeof(uint32_t);
+      while (size < n && chars[size] != 0)
+        size++;
+      size *= sizeof(uint32_t);
+    } else {
+      while (size < itemsize && item[size] != '\0')
+        size++;
+    }
+
+    SEXP charsxp = cache.lookup(item, size);
+    if (charsxp == NULL) {
+      if (typenum == NPY_UNICODE) {
+        const uint32_t* chars = (const uint32_t*) item;
+        buffer.clear();
+        for (std::size_t j = 0; j < size / sizeof(uint32_t); j++)
+          append_utf8(&buffer, chars[j]);
+        charsxp = Rf_mkCharLenCE(buffer.data(), buffer.size(), CE_UTF8);
+      } else {
+        charsxp = Rf_mkCharLenCE(item, size, CE_NATIVE);
+      }
+      cache.insert(item, size, charsxp);
+    }
+
+    SET_STRING_ELT(rArray, i, charsxp);
+  }
+
+  return rArray;
+}
+
+// decode a Python unicode object to a CHARSXP via its cached UTF-8
+// representation (avoiding a temporary bytes object); returns NULL for other
+// strings, or when the fast path isn't available (callers then fall back to
+// as_std_string)
+SEXP python_unicode_to_charsxp(PyObject* object) {
+
+  if (!PyUnicode_Check(object) || PyUnicode_AsUTF8AndSize == NULL)
+    return NULL;
+
+  Py_ssize_t size;
+  const char* utf8 = PyUnicode_AsUTF8AndSize(object, &size);
+  if (utf8 == NULL) {
+    // e.g. strings with lone surrogates
+    PyErr_Clear();
+    return NULL;
+  }
+
+  // truncate at the first null (as Rf_mkCharCE would)
+  Py_ssize_t n = 0;
+  while (n < size && utf8[n] != '\0')
+    n++;
+  return Rf_mkCharLenCE(utf8, n, CE_UTF8);
+}
+
+// convert an array of Python strings (all satisfying is_python_str) to a
+// character vector
+SEXP python_strings_to_r(PyObject** objects, npy_intp len, const IntegerVector& dims) {
+
+  RObject rArray(Rf_allocArray(STRSXP, dims));
+  CharsxpCache cache;
+
+  for (npy_intp i = 0; i < len; i++) {
+
+    PyObject* object = objects[i];
+
+    SEXP charsxp = cache.lookup(object);
+    if (charsxp == NULL) {
+
+      charsxp = python_unicode_to_charsxp(object);
+      if (charsxp == NULL) {
+        std::string str = as_std_string(object);
+        cetype_t ce = PyUnicode_Check(object) ? CE_UTF8 : CE_NATIVE;
+        charsxp = Rf_mkCharCE(str.c_str(), ce);
+      }
+
+      cache.insert(object, charsxp);
+    }
+
+    SET_STRING_ELT(rArray, i, charsxp);
+  }
+
+  return rArray;
+}
+
+
+// forward declaration
+SEXP py_to_r(PyObject* x, bool convert);
+SEXP py_to_r(PyObject* x, bool convert, kernels::Batch* batch);
+
+// convert a Python list to R in a single pass. lists whose elements are all
+// scalars of the same R type become atomic vectors: the type of the first
+// element determines the type of the vector, which is filled as the list is
+// scanned. if an element of another type is then encountered we return a
+// list instead, re-using the values converted so far.
+SEXP py_list_to_r(PyObject* x, bool convert, kernels::Batch* batch) {
+
+  Py_ssize_t len = PyList_Size(x);
+  int scalarType = len > 0 ? r_scalar_type(PyList_GetItem(x, 0)) : NILSXP;
+
+  Py_ssize_t i = 0;
+  RObject vec;
+  if (scalarType != NILSXP) {
+
+    vec = Rf_allocVector(scalarType, len);
+    PyTypeObject* firstType = Py_TYPE(PyList_GetItem(x, 0));
+    CharsxpCache cache;
+
+    for (; i < len; i++) {
+
+      // elements of the same Python type as the first element have the same
+      // scalar type (except for Python 2 byte strings, which aren't treated
+      // as strings when they contain nulls)
+      PyObject* item = PyList_GetItem(x, i);
+      bool sameType = Py_TYPE(item) == firstType &&
+        (scalarType != STRSXP || PyUnicode_Check(item));
+      if (!sameType && r_scalar_type(item) != scalarType)
+        break;
+
+      switch (scalarType) {
+      case REALSXP:
+        REAL(vec)[i] = PyFloat_AsDouble(item);
+        break;
+      case INTSXP:
+        INTEGER(vec)[i] = PyInt_AsLong(item);
+        break;
+      case CPLXSXP:
+        COMPLEX(vec)[i].r = PyComplex_RealAsDouble(item);
+        COMPLEX(vec)[i].i = PyComplex_ImagAsDouble(item);
+        break;
+      case LGLSXP:
+        LOGICAL(vec)[i] = item == Py_True;
+        break;
+      case STRSXP: {
+        SEXP charsxp = cache.lookup(item);
+        if (charsxp == NULL) {
+          charsxp = python_unicode_to_charsxp(item);
+          if (charsxp == NULL)
+            charsxp = Rf_mkCharCE(as_std_string(item).c_str(), CE_UTF8);
+          cache.insert(item, charsxp);
+        }
+        SET_STRING_ELT(vec, i, charsxp);
+        break;
+      }
+      }
+    }
+
+    // homogeneous list of scalars
+    if (i == len)
+      return vec;
+  }
+
+  // not a homogeneous list of scalars, return a list
+  Rcpp::List list(len);
+  for (Py_ssize_t j = 0; j < i; j++) {
+    switch (scalarType) {
+    case REALSXP:
+      list[j] = Rf_ScalarReal(REAL(vec)[j]);
+      break;
+    case INTSXP:
+      list[j] = Rf_ScalarInteger(INTEGER(vec)[j]);
+      break;
+    case CPLXSXP:
+      list[j] = ComplexVector::create(COMPLEX(vec)[j]);
+      break;
+    case LGLSXP:
+      list[j] = Rf_ScalarLogical(LOGICAL(vec)[j]);
+      break;
+    case STRSXP:
+      list[j] = Rf_ScalarString(STRING_ELT(vec, j));
+      break;
+    }
+  }
+
+  // copy the data of any NumPy arrays together once the list is done
+  // (unless the list is itself part of a batch)
+  kernels::Batch local;
+  kernels::Batch* items = batch != NULL ? batch : &local;
+  for (; i < len; i++)
+    list[i] = py_to_r(PyList_GetItem(x, i), convert, items);
+  local.run();
+  return list;
 }
 
 
@@ -596,6 +1178,7 @@ bool py_is_callable(PyObject* x) {
 
 // [[Rcpp::export]]
 bool py_is_callable(PyObjectRef x) {
+  GILScope _gil;
   if (x.is_null_xptr())
     return false;
   else
@@ -603,8 +1186,33 @@ bool py_is_callable(PyObjectRef x) {
 }
 
 
+// record the data copied into an R vector (for py_stats)
+void count_bytes_to_r(SEXP x) {
+  switch (TYPEOF(x)) {
+  case LGLSXP:
+  case INTSXP:
+    stats::count_bytes_to_r(XLENGTH(x) * sizeof(int));
+    break;
+  case REALSXP:
+    stats::count_bytes_to_r(XLENGTH(x) * sizeof(double));
+    break;
+  case CPLXSXP:
+    stats::count_bytes_to_r(XLENGTH(x) * sizeof(Rcomplex));
+    break;
+  }
+}
+
 // convert a python object to an R object
 SEXP py_to_r(PyObject* x, bool convert) {
+  return py_to_r(x, convert, NULL);
+}
+
+// convert a python object to an R object, queueing the copies of the data of
+// NumPy arrays in 'batch' (if given) rather than running them immediately.
+// the objects converted must then not be used until the batch has been run.
+SEXP py_to_r(PyObject* x, bool convert, kernels::Batch* batch) {
+
+  stats::count_py_to_r((PyObject*) Py_TYPE(x), Py_TYPE(x)->tp_name);
 
   // NULL for Python None
   if (py_is_none(x))
@@ -641,81 +1249,80 @@ SEXP py_to_r(PyObject* x, bool convert) {
       return R_NilValue; // keep compiler happy
   }
 
+  // converting anything other than the lists, tuples, dicts and arrays
+  // handled here (e.g. via pandas, __array__ or a py_to_r method) can run
+  // Python code which modifies the arrays whose copies are queued, so run
+  // those first
+  if (batch != NULL && !PyList_Check(x) && !PyTuple_Check(x) &&
+      !PyDict_Check(x) && !isPyArray(x))
+    batch->run();
+
   // list
-  else if (PyList_Check(x)) {
-
-    Py_ssize_t len = PyList_Size(x);
-    int scalarType = scalar_list_type(x);
-    if (scalarType == REALSXP) {
-      Rcpp::NumericVector vec(len);
-      for (Py_ssize_t i = 0; i<len; i++)
-        vec[i] = PyFloat_AsDouble(PyList_GetItem(x, i));
-      return vec;
-    } else if (scalarType == INTSXP) {
-      Rcpp::IntegerVector vec(len);
-      for (Py_ssize_t i = 0; i<len; i++)
-        vec[i] = PyInt_AsLong(PyList_GetItem(x, i));
-      return vec;
-    } else if (scalarType == CPLXSXP) {
-      Rcpp::ComplexVector vec(len);
-      for (Py_ssize_t i = 0; i<len; i++) {
-        PyObject* item = PyList_GetItem(x, i);
-        Rcomplex cplx;
-        cplx.r = PyComplex_RealAsDouble(item);
-        cplx.i = PyComplex_ImagAsDouble(item);
-        vec[i] = cplx;
-      }
-      return vec;
-    } else if (scalarType == LGLSXP) {
-      Rcpp::LogicalVector vec(len);
-      for (Py_ssize_t i = 0; i<len; i++)
-        vec[i] = PyList_GetItem(x, i) == Py_True;
-      return vec;
-    } else if (scalarType == STRSXP) {
-      Rcpp::CharacterVector vec(len);
-      for (Py_ssize_t i = 0; i<len; i++)
-        vec[i] = as_utf8_r_string(PyList_GetItem(x, i));
-      return vec;
-    } else { // not a homegenous list of scalars, return a list
-      Rcpp::List list(len);
-      for (Py_ssize_t i = 0; i<len; i++)
-        list[i] = py_to_r(PyList_GetItem(x, i), convert);
-      return list;
-    }
+  if (PyList_Check(x)) {
+    return py_list_to_r(x, convert, batch);
   }
 
   // tuple (but don't convert namedtuple as it's often a custom class)
   else if (PyTuple_Check(x) && !PyObject_HasAttrString(x, "_fields")) {
     Py_ssize_t len = PyTuple_Size(x);
     Rcpp::List list(len);
+    kernels::Batch local;
+    kernels::Batch* items = batch != NULL ? batch : &local;
     for (Py_ssize_t i = 0; i<len; i++)
-      list[i] = py_to_r(PyTuple_GetItem(x, i), convert);
+      list[i] = py_to_r(PyTuple_GetItem(x, i), convert, items);
+    local.run();
     return list;
   }
 
   // dict
   else if (PyDict_Check(x)) {
 
-    // copy the dict and allocate
-    PyObjectPtr dict(PyDict_Copy(x));
-    Py_ssize_t size = PyDict_Size(dict);
-    std::vector<std::string> names(size);
+    // with reticulate.lazy_dict set, return a proxy which converts each
+    // value on first access (see py_lazy_dict in R)
+    if (option_is_true("reticulate.lazy_dict")) {
+      PyObjectPtr keys(PyDict_Keys(x));
+      if (keys.is_null())
+        stop(py_fetch_error());
+      Py_IncRef(x);
+      PyObjectRef dict = py_ref(x, convert);
+      Rcpp::Function py_lazy_dict(s_py_lazy_dict_fn);
+      return py_lazy_dict(dict, py_ref(keys.detach(), false));
+    }
+
+    // allocate
+    Py_ssize_t size = PyDict_Size(x);
+    Rcpp::CharacterVector names(size);
     Rcpp::List list(size);
+    kernels::Batch local;
+    kernels::Batch* items = batch != NULL ? batch : &local;
 
-    // iterate over dict
+    // iterate over dict (rather than a copy of it). converting a value can
+    // run Python code, so keep references to the current key and value, and
+    // fail (as iterating over a dict in Python would) if the dict changes
+    // size along the way
     PyObject *key, *value;
     Py_ssize_t pos = 0;
     Py_ssize_t idx = 0;
-    while (PyDict_Next(dict, &pos, &key, &value)) {
+    while (PyDict_Next(x, &pos, &key, &value)) {
+      Py_IncRef(key);
+      Py_IncRef(value);
+      PyObjectPtr keyPtr(key), valuePtr(value);
       if (is_python_str(key)) {
         names[idx] = as_utf8_r_string(key);
       } else {
+        // (str() can run Python code, see above)
+        items->run();
         PyObjectPtr str(PyObject_Str(key));
+        if (str.is_null())
+          stop(py_fetch_error());
         names[idx] = as_utf8_r_string(str);
       }
-      list[idx] = py_to_r(value, convert);
+      list[idx] = py_to_r(value, convert, items);
+      if (PyDict_Size(x) != size)
+        stop("dictionary changed size during conversion");
       idx++;
     }
+    local.run();
     list.names() = names;
     return list;
 
@@ -747,68 +1354,110 @@ SEXP py_to_r(PyObject* x, bool convert) {
     // determine the target type of the array
     int typenum = narrow_array_typenum(array);
 
+    // int32 arrays can be copied directly into R integer vectors
+    if (typenum == NPY_LONG && is_int32_typenum(PyArray_TYPE(array)))
+      typenum = PyArray_TYPE(array);
+
+    // boolean arrays in any other layout (e.g. C ordered masks) are unpacked
+    // directly into fortran order, rather than first being cast
+    if (typenum == NPY_BOOL && PyArray_TYPE(array) == NPY_BOOL &&
+        !is_farray_of_type(array, NPY_BOOL)) {
+      rArray = Rf_allocArray(LGLSXP, dimsVector);
+      kernels::to_logical_strided((const npy_bool*) PyArray_DATA(array),
+                                  nd,
+                                  PyArray_DIMS(array),
+                                  PyArray_STRIDES(array),
+                                  LOGICAL(rArray));
+      count_bytes_to_r(rArray);
+      return rArray;
+    }
+
+    // convert numeric arrays which need widening (e.g. int16 or float32)
+    // directly from their buffer, rather than casting them to a temporary
+    int sourceTypenum = PyArray_TYPE(array);
+    if (sourceTypenum != typenum && is_farray_of_type(array, sourceTypenum) &&
+        ((typenum == NPY_LONG && kernels::supports_integer(sourceTypenum)) ||
+         (typenum == NPY_DOUBLE && kernels::supports_double(sourceTypenum)))) {
+      if (batch != NULL)
+        batch->retain(x);
+      if (typenum == NPY_LONG) {
+        rArray = Rf_allocArray(INTSXP, dimsVector);
+        kernels::to_integer(sourceTypenum, PyArray_DATA(array), INTEGER(rArray), len, batch);
+      } else {
+        rArray = Rf_allocArray(REALSXP, dimsVector);
+        kernels::to_double(sourceTypenum, PyArray_DATA(array), REAL(rArray), len, batch);
+      }
+      count_bytes_to_r(rArray);
+      return rArray;
+    }
+
     // cast it to a fortran array (PyArray_CastToType steals the descr)
-    // (note that we will decref the copied array below)
-    PyArray_Descr* descr = PyArray_DescrFromType(typenum);
-    array = (PyArrayObject*)PyArray_CastToType(array, descr, NPY_ARRAY_FARRAY);
-    if (array == NULL)
-      stop(py_fetch_error());
+    // (note that we will decref the copied array below). we can skip
+    // this when the array already has the required type and layout.
+    PyObjectPtr ptrArray;
+    if (is_farray_of_type(array, typenum)) {
+      Py_IncRef(x);
+      ptrArray.assign(x);
+    } else {
+      PyArray_Descr* descr = PyArray_DescrFromType(typenum);
+      array = (PyArrayObject*)PyArray_CastToType(array, descr, NPY_ARRAY_FARRAY);
+      if (array == NULL)
+        stop(py_fetch_error());
+      ptrArray.assign((PyObject*)array);
+    }
 
-    // ensure we release it within this scope
-    PyObjectPtr ptrArray((PyObject*)array);
+    // if requested, borrow the array's memory rather than copying it
+    if (option_is_true("reticulate.zero_copy")) {
+      SEXPTYPE rtype = NILSXP;
+      if (typenum == NPY_DOUBLE)
+        rtype = REALSXP;
+      else if (is_int32_typenum(typenum))
+        rtype = INTSXP;
+      if (rtype != NILSXP) {
+        rArray = altrep::wrap_python_memory(ptrArray, PyArray_DATA(array), len, rtype);
+        if (rArray != R_NilValue) {
+          rArray.attr("dim") = dimsVector;
+          return rArray;
+        }
+      }
+    }
 
-    // copy the data as required per-type
+    // copy the data as required per-type (the copies of booleans, integers
+    // and doubles may be queued in the batch)
+    if (batch != NULL)
+      batch->retain(ptrArray);
     switch(typenum) {
       case NPY_BOOL: {
-        npy_bool* pData = (npy_bool*)PyArray_DATA(array);
         rArray = Rf_allocArray(LGLSXP, dimsVector);
-        for (int i=0; i<len; i++)
-          LOGICAL(rArray)[i] = pData[i];
+        kernels::to_logical(NPY_BOOL, PyArray_DATA(array), LOGICAL(rArray), len, batch);
         break;
       }
+      case NPY_INT:
       case NPY_LONG: {
-        npy_long* pData = (npy_long*)PyArray_DATA(array);
         rArray = Rf_allocArray(INTSXP, dimsVector);
-        for (int i=0; i<len; i++)
-          INTEGER(rArray)[i] = pData[i];
+        if (is_int32_typenum(typenum)) {
+          kernels::to_integer(typenum, PyArray_DATA(array), INTEGER(rArray), len, batch);
+        } else {
+          npy_long* pData = (npy_long*)PyArray_DATA(array);
+          for (int i=0; i<len; i++)
+            INTEGER(rArray)[i] = pData[i];
+        }
         break;
       }
       case NPY_DOUBLE: {
-        npy_double* pData = (npy_double*)PyArray_DATA(array);
         rArray = Rf_allocArray(REALSXP, dimsVector);
-        for (int i=0; i<len; i++)
-          REAL(rArray)[i] = pData[i];
+        kernels::to_double(NPY_DOUBLE, PyArray_DATA(array), REAL(rArray), len, batch);
         break;
       }
       case NPY_CDOUBLE: {
-        npy_complex128* pData = (npy_complex128*)PyArray_DATA(array);
+        // npy_complex128 has the same layout as Rcomplex
         rArray = Rf_allocArray(CPLXSXP, dimsVector);
-        for (int i=0; i<len; i++) {
-          npy_complex128 data = pData[i];
-          Rcomplex cpx;
-          cpx.r = data.real;
-          cpx.i = data.imag;
-          COMPLEX(rArray)[i] = cpx;
-        }
+        std::memcpy(COMPLEX(rArray), PyArray_DATA(array), len * sizeof(Rcomplex));
         break;
       }
       case NPY_STRING:
       case NPY_UNICODE: {
-        PyObjectPtr itemFunc(PyObject_GetAttrString(ptrArray, "item"));
-        if (itemFunc.is_null())
-          stop(py_fetch_error());
-        rArray = Rf_allocArray(STRSXP, dimsVector);
-        RObject protectArray(rArray);
-        for (int i=0; i<len; i++) {
-          PyObjectPtr pyArgs(PyTuple_New(1));
-          // PyTuple_SetItem steals reference to object created by PyInt_FromLong
-          PyTuple_SetItem(pyArgs, 0, PyInt_FromLong(i));
-          PyObjectPtr pyStr(PyObject_Call(itemFunc, pyArgs, NULL));
-          if (pyStr.is_null()) {
-            stop(py_fetch_error());
-          }
-          set_string_element(rArray, i, pyStr);
-        }
+        rArray = numpy_strings_to_r(array, dimsVector, typenum);
         break;
       }
       case NPY_OBJECT: {
@@ -827,25 +1476,26 @@ SEXP py_to_r(PyObject* x, bool convert) {
 
         // return a character vector if it's all strings
         if (allStrings) {
-          rArray = Rf_allocArray(STRSXP, dimsVector);
-          RObject protectArray(rArray);
-          for (npy_intp i=0; i<len; i++)
-            set_string_element(rArray, i, pData[i]);
+          rArray = python_strings_to_r(pData, len, dimsVector);
 
         // otherwise return a list of objects
         } else {
           rArray = Rf_allocArray(VECSXP, dimsVector);
           RObject protectArray(rArray);
+          kernels::Batch local;
+          kernels::Batch* items = batch != NULL ? batch : &local;
           for (npy_intp i=0; i<len; i++) {
-            SEXP data = py_to_r(pData[i], convert);
+            SEXP data = py_to_r(pData[i], convert, items);
             SET_VECTOR_ELT(rArray, i, data);
           }
+          local.run();
         }
         break;
       }
     }
 
     // return the R Array
+    count_bytes_to_r(rArray);
     return rArray;
   }
 
@@ -900,8 +1550,7 @@ SEXP py_to_r(PyObject* x, bool convert) {
     PyObjectRef pyFunc = py_ref(x, convert);
 
     // create an R function wrapper
-    Rcpp::Environment pkgEnv = Rcpp::Environment::namespace_env("reticulate");
-    Rcpp::Function py_callable_as_function = pkgEnv["py_callable_as_function"];
+    Rcpp::Function py_callable_as_function(s_py_callable_as_function_fn);
     Rcpp::Function f = py_callable_as_function(pyFunc, convert);
 
     // forward classes
@@ -926,6 +1575,14 @@ SEXP py_to_r(PyObject* x, bool convert) {
 
   // bytearray
   else if (PyByteArray_Check(x)) {
+
+    // if requested, borrow the bytearray's memory rather than copying it
+    if (option_is_true("reticulate.zero_copy")) {
+      SEXP view = altrep::wrap_python_buffer(x);
+      if (view != R_NilValue)
+        return view;
+    }
+
     if (PyByteArray_Size(x) > 0)
       return Rcpp::RawVector(PyByteArray_AsString(x),
                              PyByteArray_AsString(x) + PyByteArray_Size(x));
@@ -942,27 +1599,258 @@ SEXP py_to_r(PyObject* x, bool convert) {
   }
 }
 
-PyObject* r_to_py(RObject x, bool convert) {
+PyObject* r_to_py_cpp(RObject x, bool convert);
 
-  // get a static reference to the R version of r_to_py
-  Rcpp::Environment pkgEnv = Rcpp::Environment::namespace_env("reticulate");
-  Rcpp::Function r_to_py_fn = pkgEnv["r_to_py"];
+// is there an r_to_py() method for one of the implicit classes of a plain
+// atomic vector (e.g. r_to_py.matrix or r_to_py.numeric)? these are looked up
+// the way UseMethod() would from the global environment: on the search path
+// and in the S3 methods table of the reticulate namespace
+bool has_implicit_class_method(SEXP sexp) {
 
-  // call the R version and hold the return value in a PyObjectRef (SEXP wrapper)
-  // this object will be released when the function returns
-  PyObjectRef ref(r_to_py_fn(x, convert));
+  static SEXP table = NULL;
+  if (table == NULL) {
+    Environment ns = Environment::namespace_env("reticulate");
+    table = Rf_findVarInFrame(ns, Rf_install(".__S3MethodsTable__."));
+  }
 
-  // get the underlying Python object and call Py_IncRef before returning it
-  // this allows this function to provide the same memory sematnics as the
-  // previous C++ version of r_to_py (which is now r_to_py_cpp), which always
-  // calls Py_IncRef on Python objects before returning them
-  PyObject* obj = ref.get();
-  Py_IncRef(obj);
+  const char* classes[4] = { NULL, NULL, NULL, NULL };
+
+  // matrices are also arrays
+  SEXP dims = Rf_getAttrib(sexp, R_DimSymbol);
+  if (dims != R_NilValue) {
+    if (Rf_length(dims) == 2)
+      classes[0] = "r_to_py.matrix";
+    classes[1] = "r_to_py.array";
+  }
+
+  switch (TYPEOF(sexp)) {
+  case LGLSXP:  classes[2] = "r_to_py.logical"; break;
+  case INTSXP:  classes[2] = "r_to_py.integer"; classes[3] = "r_to_py.numeric"; break;
+  case REALSXP: classes[2] = "r_to_py.double"; classes[3] = "r_to_py.numeric"; break;
+  case CPLXSXP: classes[2] = "r_to_py.complex"; break;
+  case STRSXP:  classes[2] = "r_to_py.character"; break;
+  case RAWSXP:  classes[2] = "r_to_py.raw"; break;
+  }
+
+  for (int i = 0; i < 4; i++) {
+    if (classes[i] == NULL)
+      continue;
+    SEXP symbol = Rf_install(classes[i]);
+    if (Rf_findVar(symbol, R_GlobalEnv) != R_UnboundValue)
+      return true;
+    if (TYPEOF(table) == ENVSXP &&
+        Rf_findVarInFrame(table, symbol) != R_UnboundValue)
+      return true;
+  }
+
+  return false;
+}
+
+PyObject* r_to_py(RObject x, bool convert) {
+
+  // plain atomic vectors (no class attribute) would be dispatched to
+  // r_to_py.default, so convert them directly rather than going through
+  // S3 dispatch in R -- unless a method has been defined for one of their
+  // implicit classes
+  SEXP sexp = x;
+  if (!OBJECT(sexp) && Rf_isVectorAtomic(sexp) && !has_implicit_class_method(sexp))
+    return r_to_py_cpp(x, convert);
+
+  // get the R version of r_to_py
+  Rcpp::Function r_to_py_fn(s_r_to_py_fn);
+
+  // call the R version and hold the return value in a PyObjectRef (SEXP wrapper)
+  // this object will be released when the function returns
+  PyObjectRef ref(r_to_py_fn(x, convert));
+
+  // get the underlying Python object and call Py_IncRef before returning it
+  // this allows this function to provide the same memory sematnics as the
+  // previous C++ version of r_to_py (which is now r_to_py_cpp), which always
+  // calls Py_IncRef on Python objects before returning them
+  PyObject* obj = ref.get();
+  Py_IncRef(obj);
 
   // return the Python object
   return obj;
 }
 
+// convert an R vector to a NumPy array with the specified dimensions. the
+// array shares memory with the R vector for integer, numeric and complex
+// vectors (the returned object will have an active reference count on it)
+PyObject* r_to_py_numpy(RObject x, std::vector<npy_intp> dims) {
+
+  int type = x.sexp_type();
+  SEXP sexp = x.get__();
+  int nd = dims.size();
+
+  int typenum;
+  void* data;
+  if (type == INTSXP) {
+    if (sizeof(long) == 4)
+      typenum = NPY_LONG;
+    else
+      typenum = NPY_INT;
+    data = &(INTEGER(sexp)[0]);
+  } else if (type == REALSXP) {
+    typenum = NPY_DOUBLE;
+    data = &(REAL(sexp)[0]);
+  } else if (type == LGLSXP) {
+    // optionally share R's (32-bit integer) storage with an int32 array
+    if (option_is_true("reticulate.logical_as_int32"))
+      typenum = sizeof(long) == 4 ? NPY_LONG : NPY_INT;
+    else
+      typenum = NPY_BOOL;
+    data = &(LOGICAL(sexp)[0]);
+  } else if (type == CPLXSXP) {
+    typenum = NPY_CDOUBLE;
+    data = &(COMPLEX(sexp)[0]);
+  } else if (type == STRSXP) {
+    typenum = NPY_OBJECT;
+    data = NULL;
+  } else {
+    stop("Matrix type cannot be converted to python (only integer, "
+         "numeric, complex, logical, and character matrixes can be "
+         "converted");
+  }
+
+  int flags = NPY_ARRAY_FARRAY_RO;
+
+  // because R logical vectors are just ints under the
+  // hood, we need to explicitly construct a boolean
+  // vector for our Python array. note that the created
+  // array will own the data so we do not free it after
+  if (typenum == NPY_BOOL) {
+    R_xlen_t n = XLENGTH(sexp);
+    npy_bool* converted = (npy_bool*) PyArray_malloc(n * sizeof(npy_bool));
+    kernels::from_logical(LOGICAL(sexp), converted, n);
+    stats::count_bytes_to_py(n * sizeof(npy_bool));
+    data = converted;
+    flags |= NPY_ARRAY_OWNDATA;
+  }
+
+  // create the matrix
+  PyObject* array = PyArray_New(&PyArray_Type,
+                                 nd,
+                                 &(dims[0]),
+                                 typenum,
+                                 NULL,
+                                 data,
+                                 0,
+                                 flags,
+                                 NULL);
+
+  // check for error
+  if (array == NULL)
+    stop(py_fetch_error());
+
+  // if this is a character vector we need to convert and set the elements,
+  // otherwise the memory is shared with the underlying R vector
+  if (type == STRSXP) {
+    void** pData = (void**)PyArray_DATA((PyArrayObject*)array);
+    R_xlen_t len = Rf_xlength(x);
+    PyStrCache local;
+    PyStrCache& cache = str_cache(local, len);
+    for (R_xlen_t i = 0; i<len; i++) {
+      PyObject* pyStr = cache.get(STRING_ELT(x, i));
+      if (pyStr == NULL) {
+        Py_DecRef(array);
+        stop(py_fetch_error());
+      }
+      pData[i] = pyStr;
+    }
+
+  } else if (!(flags & NPY_ARRAY_OWNDATA)) {
+    // wrap the R object in a capsule that's tied to the lifetime of the matrix
+    // (so the R doesn't deallocate the memory while python is still pointing to it)
+    PyObjectPtr capsule(r_object_capsule(x));
+
+    // set base object using correct version of the API (detach since this
+    // effectively steals a reference to the provided base object)
+    if (PyArray_GetNDArrayCFeatureVersion() >= NPY_1_7_API_VERSION) {
+      int res = PyArray_SetBaseObject((PyArrayObject *)array, capsule.detach());
+      if (res != 0)
+        stop(py_fetch_error());
+    } else {
+      PyArray_BASE(array) = capsule.detach();
+    }
+  }
+
+  // return it
+  return array;
+}
+
+// how atomic vectors (of any length other than 1, and without a dim
+// attribute) are converted, as set by the reticulate.vector.conversion option:
+// as lists (the default), as array.array objects (integer and numeric vectors
+// only), or as 1-D NumPy arrays (when NumPy is available). other vectors are
+// always converted to lists.
+enum VectorConversion {
+  kVectorAsList = 0,
+  kVectorAsArray,
+  kVectorAsNumPy
+};
+
+VectorConversion vector_conversion(SEXP x) {
+
+  int type = TYPEOF(x);
+  if (type != INTSXP && type != REALSXP && type != LGLSXP && type != CPLXSXP)
+    return kVectorAsList;
+
+  if (XLENGTH(x) == 1)
+    return kVectorAsList;
+
+  SEXP option = Rf_GetOption(Rf_install("reticulate.vector.conversion"), R_BaseEnv);
+  if (TYPEOF(option) != STRSXP || Rf_length(option) != 1)
+    return kVectorAsList;
+
+  const char* value = CHAR(STRING_ELT(option, 0));
+  if (std::strcmp(value, "array") == 0 && (type == INTSXP || type == REALSXP))
+    return kVectorAsArray;
+  else if (std::strcmp(value, "numpy") == 0 && haveNumPy())
+    return kVectorAsNumPy;
+  else
+    return kVectorAsList;
+}
+
+// convert an integer or numeric vector to an array.array, copying its data
+// in a single block
+PyObject* r_to_py_array_array(SEXP x) {
+
+  const char* typecode;
+  const char* data;
+  std::size_t size;
+  if (TYPEOF(x) == INTSXP) {
+    typecode = "i";
+    data = (const char*) INTEGER(x);
+    size = XLENGTH(x) * sizeof(int);
+  } else {
+    typecode = "d";
+    data = (const char*) REAL(x);
+    size = XLENGTH(x) * sizeof(double);
+  }
+
+  PyObjectPtr module(PyImport_ImportModule("array"));
+  if (module.is_null())
+    stop(py_fetch_error());
+
+  PyObjectPtr constructor(PyObject_GetAttrString(module, "array"));
+  if (constructor.is_null())
+    stop(py_fetch_error());
+
+  PyObjectPtr code(as_python_str(typecode));
+  PyObjectPtr bytes(is_python3() ?
+    PyBytes_FromStringAndSize(data, size) :
+    PyString_FromStringAndSize(data, size));
+  if (code.is_null() || bytes.is_null())
+    stop(py_fetch_error());
+
+  PyObject* array = PyObject_CallFunctionObjArgs(constructor, code.get(), bytes.get(), NULL);
+  if (array == NULL)
+    stop(py_fetch_error());
+
+  return array;
+}
+
 // convert an R object to a python object (the returned object
 // will have an active reference count on it)
 PyObject* r_to_py_cpp(RObject x, bool convert) {
@@ -970,6 +1858,8 @@ PyObject* r_to_py_cpp(RObject x, bool convert) {
   int type = x.sexp_type();
   SEXP sexp = x.get__();
 
+  stats::count_r_to_py(type);
+
   // NULL becomes python None (Py_IncRef since PyTuple_SetItem
   // will steal the passed reference)
   if (x.isNULL()) {
@@ -998,90 +1888,15 @@ PyObject* r_to_py_cpp(RObject x, bool convert) {
     std::vector<npy_intp> dims(nd);
     for (int i = 0; i<nd; i++)
       dims[i] = dimAttrib[i];
-    int typenum;
-    void* data;
-    if (type == INTSXP) {
-      if (sizeof(long) == 4)
-        typenum = NPY_LONG;
-      else
-        typenum = NPY_INT;
-      data = &(INTEGER(sexp)[0]);
-    } else if (type == REALSXP) {
-      typenum = NPY_DOUBLE;
-      data = &(REAL(sexp)[0]);
-    } else if (type == LGLSXP) {
-      typenum = NPY_BOOL;
-      data = &(LOGICAL(sexp)[0]);
-    } else if (type == CPLXSXP) {
-      typenum = NPY_CDOUBLE;
-      data = &(COMPLEX(sexp)[0]);
-    } else if (type == STRSXP) {
-      typenum = NPY_OBJECT;
-      data = NULL;
-    } else {
-      stop("Matrix type cannot be converted to python (only integer, "
-           "numeric, complex, logical, and character matrixes can be "
-           "converted");
-    }
-
-    int flags = NPY_ARRAY_FARRAY_RO;
-
-    // because R logical vectors are just ints under the
-    // hood, we need to explicitly construct a boolean
-    // vector for our Python array. note that the created
-    // array will own the data so we do not free it after
-    if (typenum == NPY_BOOL) {
-      R_xlen_t n = XLENGTH(sexp);
-      bool* converted = (bool*) PyArray_malloc(n * sizeof(bool));
-      for (R_xlen_t i = 0; i < n; i++)
-        converted[i] = LOGICAL(sexp)[i];
-      data = converted;
-      flags |= NPY_ARRAY_OWNDATA;
-    }
-
-    // create the matrix
-    PyObject* array = PyArray_New(&PyArray_Type,
-                                   nd,
-                                   &(dims[0]),
-                                   typenum,
-                                   NULL,
-                                   data,
-                                   0,
-                                   flags,
-                                   NULL);
-
-    // check for error
-    if (array == NULL)
-      stop(py_fetch_error());
+    return r_to_py_numpy(x, dims);
 
-    // if this is a character vector we need to convert and set the elements,
-    // otherwise the memory is shared with the underlying R vector
-    if (type == STRSXP) {
-      void** pData = (void**)PyArray_DATA((PyArrayObject*)array);
-      R_xlen_t len = Rf_xlength(x);
-      for (R_xlen_t i = 0; i<len; i++) {
-        PyObject* pyStr = as_python_str(STRING_ELT(x, i));
-        pData[i] = pyStr;
-      }
-
-    } else {
-      // wrap the R object in a capsule that's tied to the lifetime of the matrix
-      // (so the R doesn't deallocate the memory while python is still pointing to it)
-      PyObjectPtr capsule(r_object_capsule(x));
-
-      // set base object using correct version of the API (detach since this
-      // effectively steals a reference to the provided base object)
-      if (PyArray_GetNDArrayCFeatureVersion() >= NPY_1_7_API_VERSION) {
-        int res = PyArray_SetBaseObject((PyArrayObject *)array, capsule.detach());
-        if (res != 0)
-          stop(py_fetch_error());
-      } else {
-        PyArray_BASE(array) = capsule.detach();
-      }
-    }
-
-    // return it
-    return array;
+  // vectors as array.array objects or NumPy arrays (if requested; vectors
+  // converted as lists, kVectorAsList, fall through to the cases below)
+  } else if (VectorConversion vectors = vector_conversion(sexp)) {
+    if (vectors == kVectorAsArray)
+      return r_to_py_array_array(sexp);
+    std::vector<npy_intp> dims(1, XLENGTH(sexp));
+    return r_to_py_numpy(x, dims);
 
   // integer (pass length 1 vectors as scalars, otherwise pass list)
   } else if (type == INTSXP) {
@@ -1158,9 +1973,14 @@ PyObject* r_to_py_cpp(RObject x, bool convert) {
       return as_python_str(STRING_ELT(sexp, 0));
     } else {
       PyObjectPtr list(PyList_New(LENGTH(sexp)));
+      PyStrCache local;
+      PyStrCache& cache = str_cache(local, LENGTH(sexp));
       for (R_xlen_t i = 0; i<LENGTH(sexp); i++) {
+        PyObject* str = cache.get(STRING_ELT(sexp, i));
+        if (str == NULL)
+          stop(py_fetch_error());
         // NOTE: reference to added value is "stolen" by the list
-        int res = PyList_SetItem(list, i, as_python_str(STRING_ELT(sexp, i)));
+        int res = PyList_SetItem(list, i, str);
         if (res != 0)
           stop(py_fetch_error());
       }
@@ -1238,9 +2058,450 @@ PyObject* r_to_py_cpp(RObject x, bool convert) {
 
 // [[Rcpp::export]]
 PyObjectRef r_to_py_impl(RObject object, bool convert) {
+  GILScope _gil;
   return py_ref(r_to_py_cpp(object, convert), convert);
 }
 
+// call a method of a Python object (with no arguments)
+PyObject* py_call_method(PyObject* x, const char* name) {
+  PyObjectPtr method(PyObject_GetAttrString(x, name));
+  if (method.is_null())
+    stop(py_fetch_error());
+  PyObject* result = PyObject_CallFunctionObjArgs(method, NULL);
+  if (result == NULL)
+    stop(py_fetch_error());
+  return result;
+}
+
+// convert R date times (seconds or days since the epoch, per 'scale') to a
+// NumPy datetime64[ns] array
+PyObject* r_datetime_to_numpy(SEXP x, double scale) {
+
+  RObject values(Rf_coerceVector(x, REALSXP));
+  R_xlen_t n = Rf_xlength(values);
+
+  npy_intp dims = n;
+  PyObjectPtr array(PyArray_New(&PyArray_Type, 1, &dims, NPY_LONGLONG,
+                                NULL, NULL, 0, NPY_ARRAY_FARRAY, NULL));
+  if (array.is_null())
+    stop(py_fetch_error());
+
+  // NA becomes NaT (the smallest 64-bit integer)
+  long long* pData = (long long*) PyArray_DATA((PyArrayObject*) array.get());
+  double* pValues = REAL(values);
+  for (R_xlen_t i = 0; i<n; i++) {
+    if (ISNAN(pValues[i]))
+      pData[i] = std::numeric_limits<long long>::min();
+    else
+      pData[i] = (long long) std::floor(pValues[i] * scale + 0.5);
+  }
+
+  PyObjectPtr view(PyObject_GetAttrString(array, "view"));
+  if (view.is_null())
+    stop(py_fetch_error());
+  PyObjectPtr dtype(as_python_str("datetime64[ns]"));
+  PyObject* datetimes = PyObject_CallFunctionObjArgs(view, dtype.get(), NULL);
+  if (datetimes == NULL)
+    stop(py_fetch_error());
+  return datetimes;
+}
+
+// convert an R factor to a pandas Categorical
+PyObject* r_factor_to_categorical(SEXP x, PyObject* categorical) {
+
+  R_xlen_t n = Rf_xlength(x);
+
+  // codes are zero-based, with -1 for missing values
+  npy_intp dims = n;
+  PyObjectPtr codes(PyArray_New(&PyArray_Type, 1, &dims, NPY_INT,
+                                NULL, NULL, 0, NPY_ARRAY_FARRAY, NULL));
+  if (codes.is_null())
+    stop(py_fetch_error());
+  int* pCodes = (int*) PyArray_DATA((PyArrayObject*) codes.get());
+  int* pValues = INTEGER(x);
+  for (R_xlen_t i = 0; i<n; i++)
+    pCodes[i] = pValues[i] == NA_INTEGER ? -1 : pValues[i] - 1;
+
+  PyObjectPtr categories(r_to_py_cpp(Rf_getAttrib(x, R_LevelsSymbol), false));
+  if (!PyList_Check(categories)) {
+    // single level factors yield a scalar
+    PyObjectPtr list(PyList_New(1));
+    PyList_SetItem(list, 0, categories.detach());
+    categories.assign(list.detach());
+  }
+  PyObjectPtr ordered(PyBool_FromLong(Rf_inherits(x, "ordered")));
+
+  PyObjectPtr fromCodes(PyObject_GetAttrString(categorical, "from_codes"));
+  if (fromCodes.is_null())
+    stop(py_fetch_error());
+  PyObject* result = PyObject_CallFunctionObjArgs(fromCodes,
+                                                  codes.get(),
+                                                  categories.get(),
+                                                  ordered.get(),
+                                                  NULL);
+  if (result == NULL)
+    stop(py_fetch_error());
+  return result;
+}
+
+// convert the columns of an R data.frame into a dictionary of NumPy arrays
+// (or pandas Categoricals), which can be passed to the DataFrame constructor.
+// numeric columns are not copied (the arrays share memory with R).
+// [[Rcpp::export]]
+PyObjectRef r_convert_dataframe(RObject dataframe, bool convert) {
+  GILScope _gil;
+
+  requireNumPy();
+
+  PyObjectPtr pandas(py_import("pandas"));
+  if (pandas.is_null())
+    stop(py_fetch_error());
+  PyObjectPtr categorical(PyObject_GetAttrString(pandas, "Categorical"));
+  if (categorical.is_null())
+    stop(py_fetch_error());
+
+  SEXP namesSEXP = Rf_getAttrib(dataframe, R_NamesSymbol);
+  PyObjectPtr dict(PyDict_New());
+
+  R_xlen_t ncol = Rf_xlength(dataframe);
+  for (R_xlen_t i = 0; i<ncol; i++) {
+
+    RObject column(VECTOR_ELT(dataframe, i));
+    int type = column.sexp_type();
+
+    // other classed columns (e.g. Date, difftime, or user defined classes)
+    // are converted via r_to_py(), so that their methods are used
+    PyObjectPtr value;
+    if (Rf_isFactor(column)) {
+      value.assign(r_factor_to_categorical(column, categorical));
+    } else if (column.inherits("POSIXct")) {
+      value.assign(r_datetime_to_numpy(column, 1E9));
+    } else if (!OBJECT(column) && !column.hasAttribute("dim") &&
+               (type == INTSXP || type == REALSXP ||
+                type == LGLSXP || type == STRSXP)) {
+      std::vector<npy_intp> dims(1, Rf_xlength(column));
+      value.assign(r_to_py_numpy(column, dims));
+    } else {
+      value.assign(r_to_py(column, convert));
+    }
+
+    PyObjectPtr name(as_python_str(STRING_ELT(namesSEXP, i)));
+    if (PyDict_SetItem(dict, name, value) != 0)
+      stop(py_fetch_error());
+  }
+
+  return py_ref(dict.detach(), convert);
+}
+
+// drop the dimensions of a one dimensional array
+SEXP drop_1d_dim(SEXP x) {
+  SEXP dim = Rf_getAttrib(x, R_DimSymbol);
+  if (dim != R_NilValue && Rf_length(dim) == 1)
+    Rf_setAttrib(x, R_DimSymbol, R_NilValue);
+  return x;
+}
+
+// convert a pandas Categorical to an R factor
+SEXP py_categorical_to_factor(PyObject* categorical) {
+
+  PyObjectPtr codesPtr(PyObject_GetAttrString(categorical, "codes"));
+  if (codesPtr.is_null())
+    stop(py_fetch_error());
+  IntegerVector codes(py_to_r(codesPtr, true));
+
+  PyObjectPtr categories(PyObject_GetAttrString(categorical, "categories"));
+  if (categories.is_null())
+    stop(py_fetch_error());
+  PyObjectPtr categoryValues(PyObject_GetAttrString(categories, "values"));
+  if (categoryValues.is_null())
+    stop(py_fetch_error());
+  RObject levels(Rf_coerceVector(drop_1d_dim(py_to_r(categoryValues, true)), STRSXP));
+
+  PyObjectPtr ordered(PyObject_GetAttrString(categorical, "ordered"));
+  if (ordered.is_null())
+    stop(py_fetch_error());
+
+  R_xlen_t n = codes.length();
+  IntegerVector factor(n);
+  int* pCodes = INTEGER(codes);
+  int* pFactor = INTEGER(factor);
+  for (R_xlen_t i = 0; i<n; i++)
+    pFactor[i] = pCodes[i] < 0 ? NA_INTEGER : pCodes[i] + 1;
+
+  factor.attr("levels") = levels;
+  if (ordered.get() == Py_True)
+    factor.attr("class") = CharacterVector::create("ordered", "factor");
+  else
+    factor.attr("class") = "factor";
+  return factor;
+}
+
+// convert a NumPy datetime64 array to an R POSIXct vector (in UTC)
+SEXP py_datetime_to_posixct(PyObject* array) {
+
+  PyObjectPtr astype(PyObject_GetAttrString(array, "astype"));
+  if (astype.is_null())
+    stop(py_fetch_error());
+  PyObjectPtr dtype(as_python_str("datetime64[ns]"));
+  PyObjectPtr nanoseconds(PyObject_CallFunctionObjArgs(astype, dtype.get(), NULL));
+  if (nanoseconds.is_null())
+    stop(py_fetch_error());
+
+  // make sure we have a contiguous array of 64-bit integers
+  PyArray_Descr* descr = PyArray_DescrFromType(NPY_LONGLONG);
+  PyObjectPtr values(PyArray_CastToType((PyArrayObject*) nanoseconds.get(),
+                                        descr, NPY_ARRAY_FARRAY));
+  if (values.is_null())
+    stop(py_fetch_error());
+
+  // NaT (the smallest 64-bit integer) becomes NA
+  npy_intp n = PyArray_SIZE((PyArrayObject*) values.get());
+  const int64_t* pData = (const int64_t*) PyArray_DATA((PyArrayObject*) values.get());
+  NumericVector result(n);
+  kernels::int64_to_double_na(pData, REAL(result), n, 1E9);
+
+  result.attr("class") = CharacterVector::create("POSIXct", "POSIXt");
+  result.attr("tzone") = "UTC";
+  return result;
+}
+
+// convert the columns of a pandas DataFrame to a list of R vectors
+// [[Rcpp::export]]
+List py_convert_pandas_df(PyObjectRef df) {
+  GILScope _gil;
+
+  // iterate over (name, column) pairs
+  const char* method = PyObject_HasAttrString(df, "items") ? "items" : "iteritems";
+  PyObjectPtr items(py_call_method(df, method));
+  PyObjectPtr iterator(PyObject_GetIter(items));
+  if (iterator.is_null())
+    stop(py_fetch_error());
+
+  std::vector<RObject> columns;
+  while (true) {
+
+    PyObjectPtr item(PyIter_Next(iterator));
+    if (item.is_null()) {
+      if (PyErr_Occurred())
+        stop(py_fetch_error());
+      else
+        break;
+    }
+
+    PyObject* series = PyTuple_GetItem(item, 1); // borrowed
+    PyObjectPtr values(PyObject_GetAttrString(series, "values"));
+    if (values.is_null())
+      stop(py_fetch_error());
+
+    // check for categorical columns
+    PyObjectPtr dtype(PyObject_GetAttrString(series, "dtype"));
+    if (dtype.is_null())
+      stop(py_fetch_error());
+    bool categorical = false;
+    if (PyObject_HasAttrString(dtype, "name")) {
+      PyObjectPtr dtypeName(PyObject_GetAttrString(dtype, "name"));
+      categorical = is_python_str(dtypeName) && as_std_string(dtypeName) == "category";
+    }
+
+    if (categorical) {
+      columns.push_back(py_categorical_to_factor(values));
+    } else if (isPyArray(values) &&
+               PyArray_TYPE((PyArrayObject*) values.get()) == NPY_DATETIME) {
+      columns.push_back(py_datetime_to_posixct(values));
+    } else if (isPyArray(values)) {
+      columns.push_back(drop_1d_dim(py_to_r(values, true)));
+    } else {
+      // other column types (e.g. extension arrays) use the R level conversion
+      Py_IncRef(values);
+      Function py_to_r_fn(s_py_to_r_fn);
+      columns.push_back(drop_1d_dim(py_to_r_fn(py_ref(values, true))));
+    }
+  }
+
+  List result(columns.size());
+  for (std::size_t i = 0; i<columns.size(); i++)
+    result[i] = columns[i];
+  return result;
+}
+
+// owns Arrow schemas and arrays exported via the C Data Interface (releasing
+// them on destruction if they haven't been moved to a consumer)
+class ArrowExports {
+public:
+  ArrowExports() {}
+  ~ArrowExports() {
+    for (std::size_t i = 0; i<schemas_.size(); i++) {
+      if (schemas_[i]->release != NULL)
+        schemas_[i]->release(schemas_[i]);
+      delete schemas_[i];
+    }
+    for (std::size_t i = 0; i<arrays_.size(); i++) {
+      if (arrays_[i]->release != NULL)
+        arrays_[i]->release(arrays_[i]);
+      delete arrays_[i];
+    }
+  }
+
+  ArrowSchema* schema() {
+    schemas_.push_back(new ArrowSchema());
+    return schemas_.back();
+  }
+
+  ArrowArray* array() {
+    arrays_.push_back(new ArrowArray());
+    return arrays_.back();
+  }
+
+  const std::vector<ArrowArray*>& arrays() const { return arrays_; }
+
+private:
+  // prevent copying
+  ArrowExports(const ArrowExports&);
+  ArrowExports& operator=(const ArrowExports&);
+
+  std::vector<ArrowSchema*> schemas_;
+  std::vector<ArrowArray*> arrays_;
+};
+
+// move an Arrow C struct out of a capsule (the producer's copy is marked as
+// released so the capsule won't release it)
+template <typename T>
+void arrow_move_from_capsule(PyObject* capsule, const char* name, T* target) {
+  T* source = (T*) PyCapsule_GetPointer(capsule, name);
+  if (source == NULL)
+    stop(py_fetch_error());
+  *target = *source;
+  source->release = NULL;
+}
+
+// export a pyarrow record batch via the C Data Interface, using the Arrow
+// PyCapsule protocol when available
+void arrow_export_record_batch(PyObject* batch, ArrowSchema* schema, ArrowArray* array) {
+
+  if (PyObject_HasAttrString(batch, "__arrow_c_array__")) {
+    PyObjectPtr capsules(py_call_method(batch, "__arrow_c_array__"));
+    arrow_move_from_capsule(PyTuple_GetItem(capsules, 0), "arrow_schema", schema);
+    arrow_move_from_capsule(PyTuple_GetItem(capsules, 1), "arrow_array", array);
+    return;
+  }
+
+  PyObjectPtr exportToC(PyObject_GetAttrString(batch, "_export_to_c"));
+  if (exportToC.is_null())
+    stop(py_fetch_error());
+  PyObjectPtr arrayAddress(PyLong_FromVoidPtr(array));
+  PyObjectPtr schemaAddress(PyLong_FromVoidPtr(schema));
+  PyObjectPtr result(PyObject_CallFunctionObjArgs(exportToC,
+                                                  arrayAddress.get(),
+                                                  schemaAddress.get(),
+                                                  NULL));
+  if (result.is_null())
+    stop(py_fetch_error());
+}
+
+// export the schema of a pyarrow Table or RecordBatch
+void arrow_export_schema(PyObject* x, ArrowSchema* schema) {
+
+  PyObjectPtr pySchema(PyObject_GetAttrString(x, "schema"));
+  if (pySchema.is_null())
+    stop(py_fetch_error());
+
+  if (PyObject_HasAttrString(pySchema, "__arrow_c_schema__")) {
+    PyObjectPtr capsule(py_call_method(pySchema, "__arrow_c_schema__"));
+    arrow_move_from_capsule(capsule.get(), "arrow_schema", schema);
+    return;
+  }
+
+  PyObjectPtr exportToC(PyObject_GetAttrString(pySchema, "_export_to_c"));
+  if (exportToC.is_null())
+    stop(py_fetch_error());
+  PyObjectPtr schemaAddress(PyLong_FromVoidPtr(schema));
+  PyObjectPtr result(PyObject_CallFunctionObjArgs(exportToC, schemaAddress.get(), NULL));
+  if (result.is_null())
+    stop(py_fetch_error());
+}
+
+// convert a pyarrow Table or RecordBatch to a list of R vectors
+// [[Rcpp::export]]
+SEXP py_arrow_to_r_impl(PyObjectRef x) {
+  GILScope _gil;
+
+  arrow::release_pending();
+
+  ArrowExports exports;
+  ArrowSchema* schema = exports.schema();
+  arrow_export_schema(x, schema);
+
+  // tables are exported batch by batch
+  if (PyObject_HasAttrString(x, "to_batches")) {
+    PyObjectPtr batches(py_call_method(x, "to_batches"));
+    PyObjectPtr iterator(PyObject_GetIter(batches));
+    if (iterator.is_null())
+      stop(py_fetch_error());
+    while (true) {
+      PyObjectPtr batch(PyIter_Next(iterator));
+      if (batch.is_null()) {
+        if (PyErr_Occurred())
+          stop(py_fetch_error());
+        else
+          break;
+      }
+      arrow_export_record_batch(batch, exports.schema(), exports.array());
+    }
+  } else {
+    arrow_export_record_batch(x, exports.schema(), exports.array());
+  }
+
+  return arrow::import_record_batches(schema, exports.arrays());
+}
+
+// convert an R data.frame to a pyarrow Table
+// [[Rcpp::export]]
+PyObjectRef r_to_py_arrow_impl(RObject x, bool convert) {
+  GILScope _gil;
+
+  arrow::release_pending();
+
+  PyObjectPtr pyarrow(py_import("pyarrow"));
+  if (pyarrow.is_null())
+    stop(py_fetch_error());
+
+  ArrowExports exports;
+  ArrowSchema* schema = exports.schema();
+  ArrowArray* array = exports.array();
+  arrow::export_data_frame(x, schema, array);
+
+  // import as a record batch (this moves the exported data into pyarrow)
+  PyObjectPtr recordBatch(PyObject_GetAttrString(pyarrow, "RecordBatch"));
+  if (recordBatch.is_null())
+    stop(py_fetch_error());
+  PyObjectPtr importFromC(PyObject_GetAttrString(recordBatch, "_import_from_c"));
+  if (importFromC.is_null())
+    stop(py_fetch_error());
+  PyObjectPtr arrayAddress(PyLong_FromVoidPtr(array));
+  PyObjectPtr schemaAddress(PyLong_FromVoidPtr(schema));
+  PyObjectPtr batch(PyObject_CallFunctionObjArgs(importFromC,
+                                                 arrayAddress.get(),
+                                                 schemaAddress.get(),
+                                                 NULL));
+  if (batch.is_null())
+    stop(py_fetch_error());
+
+  // create a table from the batch
+  PyObjectPtr table(PyObject_GetAttrString(pyarrow, "Table"));
+  if (table.is_null())
+    stop(py_fetch_error());
+  PyObjectPtr fromBatches(PyObject_GetAttrString(table, "from_batches"));
+  if (fromBatches.is_null())
+    stop(py_fetch_error());
+  PyObjectPtr batches(PyList_New(1));
+  PyList_SetItem(batches, 0, batch.detach());
+  PyObject* result = PyObject_CallFunctionObjArgs(fromBatches, batches.get(), NULL);
+  if (result == NULL)
+    stop(py_fetch_error());
+
+  return py_ref(result, convert);
+}
+
 // custom module used for calling R functions from python wrappers
 
 
@@ -1281,7 +2542,7 @@ extern "C" PyObject* call_r_function(PyObject *self, PyObject* args, PyObject* k
   }
 
   // combine positional and keyword arguments
-  Function append("append");
+  Function append(s_append_fn);
   rArgs = append(rArgs, rKeywords);
 
   // Some special constants for various special error conditions
@@ -1292,8 +2553,15 @@ extern "C" PyObject* call_r_function(PyObject *self, PyObject* args, PyObject* k
   // call the R function
   std::string err;
   try {
-    Function doCall("do.call");
-    RObject result = doCall(rFunction, rArgs);
+    Function doCall(s_do_call_fn);
+    RObject result;
+    {
+      // release the GIL while R is running; R code which calls back into
+      // Python will re-acquire it
+      GILUnlocker unlocker;
+      stats::Timer timer(stats::record_r_callback);
+      result = doCall(rFunction, rArgs);
+    }
     return r_to_py(result, convert);
   } catch(const Rcpp::internal::InterruptedException& e) {
     err = kInterruptError;
@@ -1340,7 +2608,7 @@ int call_python_function(void* data) {
   // delete the call object (will decref the members)
   delete call;
 
-  // return status as per https://docs.python.org/3/c-api/init.html#c.Py_AddPendingCall
+  // return status as expected by event_loop::schedule
   if (!res.is_null())
     return 0;
   else
@@ -1361,41 +2629,9 @@ extern "C" PyObject* call_python_function_on_main_thread(
   // decrefed when the call object is destroyed)
   PythonCall* call = new PythonCall(func, data);
 
-  // Schedule calling the function. Note that we have at least one report of Py_AddPendingCall
-  // returning -1, the source code for Py_AddPendingCall is here:
-  // https://github.com/python/cpython/blob/faa135acbfcd55f79fb97f7525c8aa6f5a5b6a22/Python/ceval.c#L321-L361
-  // From this it looks like it can fail if:
-  //
-  //   (a) It can't acquire the _PyRuntime.ceval.pending.lock after 100 tries; or
-  //   (b) There are more than NPENDINGCALLS already queued
-  //
-  // As a result we need to check for failure and then sleep and retry in that case.
-  //
-  // This could in theory result in waiting "forever" but note that if we never successfully
-  // add the pending call then we will wait forever anyway as the result queue will
-  // never be signaled, i.e. see this code which waits on the call:
-  // https://github.com/rstudio/reticulate/blob/b507f954dc08c16710f0fb39328b9770175567c0/inst/python/rpytools/generator.py#L27-L36)
-  //
-  // As a diagnostic for perverse failure to schedule the call, print a message to stderr
-  // every 60 seconds
-  //
-  const size_t wait_ms = 100;
-  size_t waited_ms = 0;
-  while(true) {
-
-    // try to schedule the pending call (exit loop on success)
-    if (Py_AddPendingCall(call_python_function, call) == 0)
-      break;
-
-    // otherwise sleep for wait_ms
-    using namespace tthread;
-    this_thread::sleep_for(chrono::milliseconds(wait_ms));
-
-    // increment total wait time and print a warning every 60 seconds
-    waited_ms += wait_ms;
-    if ((waited_ms % 60000) == 0)
-      PySys_WriteStderr("Waiting to schedule call on main R interpeter thread...\n");
-  }
+  // queue the call to be run on the main thread (this never blocks; see
+  // event_loop.cpp for details)
+  event_loop::schedule(call_python_function, call);
 
   // return none
   Py_IncRef(Py_None);
@@ -1403,11 +2639,82 @@ extern "C" PyObject* call_python_function_on_main_thread(
 }
 
 
+// names of the buckets of a latency histogram
+std::string latency_bucket_name(int bucket) {
+  std::ostringstream ostr;
+  uint64_t limit = stats::bucket_limit_us(bucket);
+  if (limit != 0)
+    ostr << "<" << limit << "us";
+  else
+    ostr << ">=" << stats::bucket_limit_us(bucket - 1) << "us";
+  return ostr.str();
+}
+
+// set an item of a Python dictionary (stealing the reference to 'value')
+void py_dict_set_stat(PyObject* dict, const std::string& key, PyObject* value) {
+  PyObjectPtr valuePtr(value);
+  if (valuePtr.is_null() || PyDict_SetItemString(dict, key.c_str(), valuePtr) != 0)
+    throw std::runtime_error("error creating statistics dictionary");
+}
+
+PyObject* py_latency_dict(const stats::Latency& latency) {
+  PyObjectPtr dict(PyDict_New());
+  py_dict_set_stat(dict, "count", PyFloat_FromDouble(latency.count));
+  py_dict_set_stat(dict, "total_seconds", PyFloat_FromDouble(latency.totalNs / 1E9));
+  PyObjectPtr buckets(PyDict_New());
+  for (int i = 0; i < stats::kLatencyBuckets; i++)
+    py_dict_set_stat(buckets, latency_bucket_name(i), PyFloat_FromDouble(latency.buckets[i]));
+  py_dict_set_stat(dict, "latency", buckets.detach());
+  return dict.detach();
+}
+
+// rpycall.stats(): the counters reported by py_stats(), as a dictionary
+extern "C" PyObject* py_stats_dict(PyObject *self, PyObject* args) {
+
+  stats::Snapshot snapshot = stats::snapshot();
+
+  try {
+
+    PyObjectPtr dict(PyDict_New());
+
+    PyObjectPtr pyToR(PyDict_New());
+    for (std::size_t i = 0; i < snapshot.pyToR.size(); i++)
+      py_dict_set_stat(pyToR, snapshot.pyToR[i].first, PyFloat_FromDouble(snapshot.pyToR[i].second));
+    py_dict_set_stat(dict, "py_to_r", pyToR.detach());
+
+    PyObjectPtr rToPy(PyDict_New());
+    for (std::size_t i = 0; i < snapshot.rToPy.size(); i++)
+      py_dict_set_stat(rToPy, Rf_type2char(snapshot.rToPy[i].first), PyFloat_FromDouble(snapshot.rToPy[i].second));
+    py_dict_set_stat(dict, "r_to_py", rToPy.detach());
+
+    py_dict_set_stat(dict, "bytes_to_r", PyFloat_FromDouble(snapshot.bytesToR));
+    py_dict_set_stat(dict, "bytes_to_py", PyFloat_FromDouble(snapshot.bytesToPy));
+    py_dict_set_stat(dict, "python_calls", py_latency_dict(snapshot.pythonCalls));
+    py_dict_set_stat(dict, "r_callbacks", py_latency_dict(snapshot.rCallbacks));
+
+    PyObjectPtr tasks(PyDict_New());
+    py_dict_set_stat(tasks, "scheduled", PyFloat_FromDouble(snapshot.tasksScheduled));
+    py_dict_set_stat(tasks, "completed", PyFloat_FromDouble(snapshot.tasksCompleted));
+    py_dict_set_stat(tasks, "max_pending", PyFloat_FromDouble(snapshot.taskQueueMaxDepth));
+    py_dict_set_stat(dict, "main_thread_tasks", tasks.detach());
+
+    py_dict_set_stat(dict, "event_polls", PyFloat_FromDouble(snapshot.pollTicks));
+
+    return dict.detach();
+
+  } catch(const std::exception& e) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    return NULL;
+  }
+}
+
 PyMethodDef RPYCallMethods[] = {
   { "call_r_function", (PyCFunction)call_r_function,
     METH_VARARGS | METH_KEYWORDS, "Call an R function" },
   { "call_python_function_on_main_thread", (PyCFunction)call_python_function_on_main_thread,
     METH_VARARGS | METH_KEYWORDS, "Call a Python function on the main thread" },
+  { "stats", (PyCFunction)py_stats_dict,
+    METH_VARARGS, "Get conversion and call statistics" },
   { NULL, NULL, 0, NULL }
 };
 
@@ -1430,9 +2737,32 @@ extern "C" PyObject* initializeRPYCall(void) {
 // forward declare py_run_file
 PyObjectRef py_run_file_impl(const std::string& file);
 
+// read the contents of a source file (in a single block, sized from the
+// length of the file); returns false if the file couldn't be read
+bool read_source_file(const std::string& path, std::string* pContents) {
+
+  std::ifstream ifs(path.c_str(), std::ios::in | std::ios::binary);
+  if (!ifs)
+    return false;
+
+  ifs.seekg(0, std::ios::end);
+  std::streamoff size = ifs.tellg();
+  ifs.seekg(0, std::ios::beg);
+  if (size < 0)
+    return false;
+
+  pContents->resize(size);
+  if (size > 0)
+    ifs.read(&(*pContents)[0], size);
+  return !ifs.fail();
+}
+
+
 // [[Rcpp::export]]
 void py_activate_virtualenv(const std::string& script)
 {
+  GILScope _gil;
+
   // get main dict
   PyObject* main = PyImport_AddModule("__main__");
   PyObject* mainDict = PyModule_GetDict(main);
@@ -1445,11 +2775,9 @@ void py_activate_virtualenv(const std::string& script)
     stop(py_fetch_error());
 
   // read the code in the script
-  std::ifstream ifs(script.c_str());
-  if (!ifs)
+  std::string code;
+  if (!read_source_file(script, &code))
     stop("Unable to open file '%s' (does it exist?)", script);
-  std::string code((std::istreambuf_iterator<char>(ifs)),
-                   (std::istreambuf_iterator<char>()));
 
   // run string
   PyObjectPtr runRes(PyRun_StringFlags(code.c_str(), Py_file_input, mainDict, localDict, NULL));
@@ -1457,45 +2785,35 @@ void py_activate_virtualenv(const std::string& script)
     stop(py_fetch_error());
 }
 
-void trace_print(int threadId, PyFrameObject *frame) {
-  std::string tracemsg = "";
-  while (NULL != frame) {
-    std::string filename = as_std_string(frame->f_code->co_filename);
-    std::string funcname = as_std_string(frame->f_code->co_name);
-    tracemsg = funcname + " " + tracemsg;
-
-    frame = frame->f_back;
-  }
-
-  tracemsg = "THREAD: [" + tracemsg + "]\n";
-  PySys_WriteStderr(tracemsg.c_str());
-}
-
-void trace_thread_main(void* aArg) {
-  using namespace tthread;
-
-  int* tracems = (int*)aArg;
-
-  while (true) {
-    PyGILState_STATE gstate;
-    gstate = PyGILState_Ensure();
-
-    PyThreadState* pState = PyGILState_GetThisThreadState();
-
-    while (pState != NULL) {
-      trace_print(pState->thread_id, pState->frame);
-      pState = PyThreadState_Next(pState);
-    }
-
-    PyGILState_Release(gstate);
-
-    this_thread::sleep_for(chrono::milliseconds(*tracems));
+// number of samples kept by the profiler when started via
+// RETICULATE_DUMP_STACK_TRACE (as for py_profile_start())
+const int kProfileDefaultSamples = 10000;
+
+// is the profile started via RETICULATE_DUMP_STACK_TRACE to be written when
+// R exits? (it isn't once it has been collected with py_profile_stop())
+bool s_profile_at_exit = false;
+void profile_write_at_exit(SEXP);
+
+// read the event polling interval (in milliseconds) from the
+// reticulate.event_polling option: FALSE disables polling, and NULL or TRUE
+// selects the default interval (see event_loop.cpp)
+int event_polling_interval() {
+  SEXP option = Rf_GetOption(Rf_install("reticulate.event_polling"), R_BaseEnv);
+  if (Rf_isLogical(option) && Rf_length(option) == 1)
+    return LOGICAL(option)[0] == FALSE ? -1 : 0;
+  if (Rf_isNumeric(option) && Rf_length(option) == 1) {
+    double value = Rf_asReal(option);
+    if (!R_IsNA(value) && value >= 1)
+      return (int) value;
   }
+  return 0;
 }
 
-tthread::thread* ptrace_thread;
-void trace_thread_init(int tracems) {
-  ptrace_thread = new tthread::thread(trace_thread_main, &tracems);
+// create the GIL (required for Python < 3.7, where it isn't created until
+// the first thread is started)
+void initialize_threads() {
+  if (PyEval_InitThreads != NULL)
+    PyEval_InitThreads();
 }
 
 // [[Rcpp::export]]
@@ -1511,11 +2829,18 @@ void py_initialize(const std::string& python,
   s_isPython3 = python3;
   s_isInteractive = interactive;
 
+  // resolve the R functions we call from C++
+  initialize_r_functions();
+
   // load the library
   std::string err;
   if (!libPython().load(libpython, is_python3(), &err))
     stop(err);
 
+  // note whether we are embedded within an existing Python session (in
+  // which case the host is responsible for the GIL)
+  bool embedded = Py_IsInitialized();
+
   if (is_python3()) {
 
     // set program name
@@ -1538,6 +2863,7 @@ void py_initialize(const std::string& python,
 
       // initialize python
       Py_Initialize();
+      initialize_threads();
     }
 
     const wchar_t *argv[1] = {s_python_v3.c_str()};
@@ -1556,6 +2882,7 @@ void py_initialize(const std::string& python,
     if (!Py_IsInitialized()) {
       // initialize python
       Py_Initialize();
+      initialize_threads();
     }
 
     // add rpycall module
@@ -1573,21 +2900,33 @@ void py_initialize(const std::string& python,
   if (!virtualenv_activate.empty())
     py_activate_virtualenv(virtualenv_activate);
 
-  // resovlve numpy
-  if (numpy_load_error.empty())
-    import_numpy_api(is_python3(), &s_numpy_load_error);
-  else
-    s_numpy_load_error = numpy_load_error;
+  // numpy is resolved on first use (see resolveNumPy), unless we already
+  // know that it isn't available
+  s_numpy_load_error = numpy_load_error;
+  s_numpy_resolved = !numpy_load_error.empty();
 
-  // initialize trace
+  // start the profiler if requested (the samples are written when R exits,
+  // unless they're collected with py_profile_stop() before then)
   Function sysGetEnv("Sys.getenv");
   std::string tracems_env = as<std::string>(sysGetEnv("RETICULATE_DUMP_STACK_TRACE", 0));
   int tracems = ::atoi(tracems_env.c_str());
-  if (tracems > 0)
-    trace_thread_init(tracems);
+  if (tracems > 0) {
+    std::string err;
+    if (!profiler::start(tracems, kProfileDefaultSamples, is_python3(), s_profile_calls_fn, &err))
+      stop(err);
+    s_profile_at_exit = true;
+    SEXP sentinel = R_MakeExternalPtr(NULL, R_NilValue, R_NilValue);
+    R_PreserveObject(sentinel);
+    R_RegisterCFinalizerEx(sentinel, profile_write_at_exit, TRUE);
+  }
 
   // poll for events while executing python code
-  event_loop::initialize();
+  event_loop::initialize(s_isInteractive, event_polling_interval());
+
+  // release the GIL while control is in R so that Python background threads
+  // can run; entry points from R into Python re-acquire it (see GILScope)
+  if (!embedded)
+    PyEval_SaveThread();
 }
 
 // [[Rcpp::export]]
@@ -1602,11 +2941,13 @@ void py_finalize() {
 
 // [[Rcpp::export]]
 bool py_is_none(PyObjectRef x) {
+  GILScope _gil;
   return py_is_none(x.get());
 }
 
 // [[Rcpp::export]]
 bool py_compare_impl(PyObjectRef a, PyObjectRef b, const std::string& op) {
+  GILScope _gil;
 
   int opcode;
   if (op == "==")
@@ -1634,6 +2975,7 @@ bool py_compare_impl(PyObjectRef a, PyObjectRef b, const std::string& op) {
 
 // [[Rcpp::export]]
 CharacterVector py_str_impl(PyObjectRef x) {
+  GILScope _gil;
 
   if (!is_python_str(x)) {
     PyObjectPtr str(PyObject_Str(x));
@@ -1647,6 +2989,7 @@ CharacterVector py_str_impl(PyObjectRef x) {
 
 // [[Rcpp::export]]
 void py_print(PyObjectRef x) {
+  GILScope _gil;
   CharacterVector out = py_str_impl(x);
   Rf_PrintValue(out);
   Rcout << std::endl;
@@ -1654,6 +2997,7 @@ void py_print(PyObjectRef x) {
 
 // [[Rcpp::export]]
 bool py_is_function(PyObjectRef x) {
+  GILScope _gil;
   return PyFunction_Check(x) == 1;
 }
 
@@ -1693,12 +3037,14 @@ void py_validate_xptr(PyObjectRef x) {
 
 // [[Rcpp::export]]
 bool py_numpy_available_impl() {
+  GILScope _gil;
   return haveNumPy();
 }
 
 
 // [[Rcpp::export]]
 std::vector<std::string> py_list_attributes_impl(PyObjectRef x) {
+  GILScope _gil;
   std::vector<std::string> attributes;
   PyObjectPtr attrs(PyObject_Dir(x));
   if (attrs.is_null())
@@ -1710,45 +3056,174 @@ std::vector<std::string> py_list_attributes_impl(PyObjectRef x) {
     attributes.push_back(as_std_string(item));
   }
 
-  return attributes;
+  return attributes;
+}
+
+// interned Python strings for attribute names, so that repeated lookups of an
+// attribute don't need to create (and hash) a new string each time. the
+// number of names is bounded in case of code which generates them.
+typedef std::map<std::string, PyObject*> AttrNames;
+AttrNames s_attr_names;
+const std::size_t kMaxAttrNames = 4096;
+
+// (returns a new reference)
+PyObject* py_attr_name(const std::string& name) {
+
+  AttrNames::iterator it = s_attr_names.find(name);
+  if (it != s_attr_names.end()) {
+    Py_IncRef(it->second);
+    return it->second;
+  }
+
+  PyObject* interned = PyString_InternFromString(name.c_str());
+  if (interned == NULL)
+    stop(py_fetch_error());
+
+  if (s_attr_names.size() < kMaxAttrNames) {
+    Py_IncRef(interned);
+    s_attr_names[name] = interned;
+  }
+
+  return interned;
+}
+
+// [[Rcpp::export]]
+bool py_has_attr_impl(PyObjectRef x, const std::string& name) {
+  GILScope _gil;
+  if (py_is_null_xptr(x))
+    return false;
+  PyObjectPtr attrName(py_attr_name(name));
+  return PyObject_HasAttr(x, attrName);
+}
+
+// [[Rcpp::export]]
+PyObjectRef py_get_attr_impl(PyObjectRef x, const std::string& name, bool silent = false) {
+  GILScope _gil;
+
+  PyObjectPtr attrName(py_attr_name(name));
+  PyObject* attr = PyObject_GetAttr(x, attrName);
+
+  if (attr == NULL) {
+
+    std::string err = py_fetch_error();
+
+    if (!silent) {
+      // error if we aren't silent
+      stop(err);
+    } else {
+      // otherwise set it to PyNone
+      attr = Py_None;
+      Py_IncRef(attr);
+    }
+  }
+
+  return py_ref(attr, x.convert());
+}
+
+// [[Rcpp::export]]
+void py_set_attr_impl(PyObjectRef x, const std::string& name, RObject value) {
+  GILScope _gil;
+  PyObjectPtr converted(r_to_py(value, x.convert()));
+  PyObjectPtr attrName(py_attr_name(name));
+  int res = PyObject_SetAttr(x, attrName, converted);
+  if (res != 0)
+    stop(py_fetch_error());
+}
+
+// handles for callable attributes accessed via `$` (e.g. methods called in a
+// loop): the R function created for the attribute is kept (as an entry in an
+// 'attr_cache' environment within the owning object) along with the attribute
+// itself, and is returned again for as long as looking up the attribute
+// yields the same object. bound methods are created afresh on each access so
+// those are instead compared for equality (i.e. the same function bound to
+// the same object).
+enum AttrCacheEntry {
+  kAttrCacheObject,
+  kAttrCacheWrapper,
+  kAttrCacheConvert,
+  kAttrCacheGeneration,
+  kAttrCacheEntrySize
+};
+
+bool is_bound_method(PyObject* x) {
+  const char* name = Py_TYPE(x)->tp_name;
+  return std::strcmp(name, "method") == 0 ||
+         std::strcmp(name, "instancemethod") == 0 ||
+         std::strcmp(name, "builtin_function_or_method") == 0 ||
+         std::strcmp(name, "method-wrapper") == 0;
+}
+
+bool is_same_attribute(PyObject* attr, PyObject* cached) {
+
+  if (attr == cached)
+    return true;
+
+  if (Py_TYPE(attr) != Py_TYPE(cached) || !is_bound_method(attr))
+    return false;
+
+  int res = PyObject_RichCompareBool(attr, cached, Py_EQ);
+  if (res == -1) {
+    PyErr_Clear();
+    return false;
+  }
+
+  return res == 1;
 }
 
-// [[Rcpp::export]]
-bool py_has_attr_impl(PyObjectRef x, const std::string& name) {
-  if (py_is_null_xptr(x))
-    return false;
-  else
-    return PyObject_HasAttrString(x, name.c_str());
+SEXP attr_cache_symbol() {
+  static SEXP symbol = Rf_install("attr_cache");
+  return symbol;
 }
 
+// returns the cached R function for the attribute if it is still valid, and
+// otherwise a reference to the attribute (as for py_get_attr_impl)
 // [[Rcpp::export]]
-PyObjectRef py_get_attr_impl(PyObjectRef x, const std::string& name, bool silent = false) {
+SEXP py_get_attr_cached(PyObjectRef x, const std::string& name) {
+  GILScope _gil;
 
-  PyObject* attr = PyObject_GetAttrString(x, name.c_str());
-
-  if (attr == NULL) {
-
-    std::string err = py_fetch_error();
+  PyObjectPtr attrName(py_attr_name(name));
+  PyObjectPtr attr(PyObject_GetAttr(x, attrName));
+  if (attr.is_null())
+    stop(py_fetch_error());
 
-    if (!silent) {
-      // error if we aren't silent
-      stop(err);
-    } else {
-      // otherwise set it to PyNone
-      attr = Py_None;
-      Py_IncRef(attr);
+  SEXP cache = Rf_findVarInFrame(x.get__(), attr_cache_symbol());
+  if (TYPEOF(cache) == ENVSXP) {
+    SEXP entry = Rf_findVarInFrame(cache, Rf_install(name.c_str()));
+    if (TYPEOF(entry) == VECSXP &&
+        Rf_length(entry) == kAttrCacheEntrySize &&
+        Rf_asInteger(VECTOR_ELT(entry, kAttrCacheGeneration)) == s_class_cache_generation &&
+        Rf_asLogical(VECTOR_ELT(entry, kAttrCacheConvert)) == x.convert())
+    {
+      PyObjectRef cached(VECTOR_ELT(entry, kAttrCacheObject));
+      if (!cached.is_null_xptr() && is_same_attribute(attr, cached.get()))
+        return VECTOR_ELT(entry, kAttrCacheWrapper);
     }
   }
 
-  return py_ref(attr, x.convert());
+  return py_ref(attr.detach(), x.convert());
 }
 
 // [[Rcpp::export]]
-void py_set_attr_impl(PyObjectRef x, const std::string& name, RObject value) {
-  PyObjectPtr converted(r_to_py(value, x.convert()));
-  int res = PyObject_SetAttrString(x, name.c_str(), converted);
-  if (res != 0)
-    stop(py_fetch_error());
+void py_attr_cache_store(PyObjectRef x,
+                         const std::string& name,
+                         PyObjectRef attr,
+                         RObject wrapper)
+{
+  Environment cache;
+  SEXP existing = Rf_findVarInFrame(x.get__(), attr_cache_symbol());
+  if (TYPEOF(existing) == ENVSXP) {
+    cache = existing;
+  } else {
+    cache = new_empty_env(true);
+    Rf_defineVar(attr_cache_symbol(), cache, x.get__());
+  }
+
+  List entry(kAttrCacheEntrySize);
+  entry[kAttrCacheObject] = attr;
+  entry[kAttrCacheWrapper] = wrapper;
+  entry[kAttrCacheConvert] = x.convert();
+  entry[kAttrCacheGeneration] = s_class_cache_generation;
+  cache.assign(name, entry);
 }
 
 
@@ -1757,6 +3232,7 @@ void py_set_attr_impl(PyObjectRef x, const std::string& name, RObject value) {
 IntegerVector py_get_attribute_types(
     PyObjectRef x,
     const std::vector<std::string>& attributes) {
+  GILScope _gil;
 
   const int UNKNOWN     =  0;
   const int VECTOR      =  1;
@@ -1799,61 +3275,157 @@ IntegerVector py_get_attribute_types(
 
 // [[Rcpp::export]]
 SEXP py_ref_to_r_with_convert(PyObjectRef x, bool convert) {
+  GILScope _gil;
   return py_to_r(x, convert);
 }
 
 // [[Rcpp::export]]
 SEXP py_ref_to_r(PyObjectRef x) {
+  GILScope _gil;
   return py_ref_to_r_with_convert(x, x.convert());
 }
 
+// convert an R vector to a 1-D NumPy array which shares its memory (for
+// integer, numeric and complex vectors). used for the index and data arrays
+// of sparse matrices.
+// [[Rcpp::export]]
+PyObjectRef py_numpy_vector_impl(RObject x) {
+  GILScope _gil;
+  requireNumPy();
+  std::vector<npy_intp> dims(1, Rf_xlength(x));
+  return py_ref(r_to_py_numpy(x, dims), false);
+}
+
+// convert a 1-D NumPy array to an R vector (without a dim attribute). as for
+// arrays, the vector borrows the array's memory when the reticulate.zero_copy
+// option is set and its type allows
+// [[Rcpp::export]]
+SEXP py_numpy_vector_to_r_impl(PyObjectRef x) {
+  GILScope _gil;
+
+  if (!isPyArray(x) || PyArray_NDIM((PyArrayObject*) x.get()) != 1)
+    stop("'x' must be a 1-D NumPy array");
+
+  RObject vector(py_to_r(x, true));
+  Rf_setAttrib(vector, R_DimSymbol, R_NilValue);
+  return vector;
+}
+
+// [[Rcpp::export]]
+SEXP py_buffer_view_impl(PyObjectRef x) {
+  GILScope _gil;
+
+  if (!altrep::available())
+    stop("Buffer views require R >= 3.5.0");
+
+  SEXP view = altrep::wrap_python_buffer(x);
+  if (view == R_NilValue)
+    stop("Object does not expose a contiguous buffer of doubles, 32-bit integers or bytes");
+
+  return view;
+}
+
 
 
 
+// whether any keyword argument name is given more than once
+bool has_duplicate_names(SEXP names) {
+  R_xlen_t n = Rf_xlength(names);
+  if (n < 2)
+    return false;
+  std::set<std::string> seen;
+  for (R_xlen_t i = 0; i<n; i++) {
+    if (!seen.insert(Rf_translateCharUTF8(STRING_ELT(names, i))).second)
+      return true;
+  }
+  return false;
+}
+
 // [[Rcpp::export]]
 SEXP py_call_impl(PyObjectRef x, List args = R_NilValue, List keywords = R_NilValue) {
+  GILScope _gil;
+  profiler::Boundary _boundary;
+  stats::Timer timer(stats::record_python_call);
+
+  R_xlen_t nargs = args.length();
+  R_xlen_t nkeywords = keywords.length();
+
+  // keyword arguments given more than once go through a dict (so that the
+  // last value is used), as vectorcall requires unique keyword names
+  bool vectorcall = PyObject_Vectorcall != NULL &&
+    !has_duplicate_names(Rf_getAttrib(keywords, R_NamesSymbol));
+
+  PyObjectPtr result;
+  if (vectorcall) {
+
+    // use vectorcall when available: positional arguments followed by keyword
+    // values are passed in a single array (with an extra leading slot so that
+    // callees can use PY_VECTORCALL_ARGUMENTS_OFFSET), and keyword names are
+    // passed as a tuple
+    PyObjectVector argv(nargs + nkeywords + 1);
+    for (R_xlen_t i = 0; i<nargs; i++)
+      argv[i + 1] = r_to_py(args.at(i), x.convert());
+
+    PyObjectPtr pyKeywordNames;
+    if (nkeywords > 0) {
+      pyKeywordNames.assign(PyTuple_New(nkeywords));
+      SEXP namesSEXP = Rf_getAttrib(keywords, R_NamesSymbol);
+      for (R_xlen_t i = 0; i<nkeywords; i++) {
+        // NOTE: reference to name is "stolen" by the tuple
+        int res = PyTuple_SetItem(pyKeywordNames, i, as_python_str(STRING_ELT(namesSEXP, i)));
+        if (res != 0)
+          stop(py_fetch_error());
+        argv[nargs + i + 1] = r_to_py(keywords.at(i), x.convert());
+      }
+    }
+
+    // call the function
+    size_t nargsf = ((size_t) nargs) | PY_VECTORCALL_ARGUMENTS_OFFSET;
+    result.assign(PyObject_Vectorcall(x, argv.data() + 1, nargsf, pyKeywordNames));
+
+  } else {
 
-  // unnamed arguments
-  PyObjectPtr pyArgs(PyTuple_New(args.length()));
-  if (args.length() > 0) {
-    for (R_xlen_t i = 0; i<args.size(); i++) {
+    // unnamed arguments
+    PyObjectPtr pyArgs(PyTuple_New(nargs));
+    for (R_xlen_t i = 0; i<nargs; i++) {
       PyObject* arg = r_to_py(args.at(i), x.convert());
       // NOTE: reference to arg is "stolen" by the tuple
       int res = PyTuple_SetItem(pyArgs, i, arg);
       if (res != 0)
         stop(py_fetch_error());
     }
-  }
 
-  // named arguments
-  PyObjectPtr pyKeywords(PyDict_New());
-  if (keywords.length() > 0) {
-    CharacterVector names = keywords.names();
-    SEXP namesSEXP = names;
-    for (R_xlen_t i = 0; i<keywords.length(); i++) {
-      const char* name = Rf_translateChar(STRING_ELT(namesSEXP, i));
-      PyObjectPtr arg(r_to_py(keywords.at(i), x.convert()));
-      int res = PyDict_SetItemString(pyKeywords, name, arg);
-      if (res != 0)
-        stop(py_fetch_error());
+    // named arguments (we pass NULL when there are none)
+    PyObjectPtr pyKeywords;
+    if (nkeywords > 0) {
+      pyKeywords.assign(PyDict_New());
+      SEXP namesSEXP = Rf_getAttrib(keywords, R_NamesSymbol);
+      for (R_xlen_t i = 0; i<nkeywords; i++) {
+        const char* name = Rf_translateChar(STRING_ELT(namesSEXP, i));
+        PyObjectPtr arg(r_to_py(keywords.at(i), x.convert()));
+        int res = PyDict_SetItemString(pyKeywords, name, arg);
+        if (res != 0)
+          stop(py_fetch_error());
+      }
     }
-  }
 
-  // call the function
-  PyObjectPtr res(PyObject_Call(x, pyArgs, pyKeywords));
+    // call the function
+    result.assign(PyObject_Call(x, pyArgs, pyKeywords));
+  }
 
   // check for error
-  if (res.is_null())
+  if (result.is_null())
     stop(py_fetch_error());
 
   // return
-  Py_IncRef(res);
-  return py_ref(res, x.convert());
+  Py_IncRef(result);
+  return py_ref(result, x.convert());
 }
 
 
 // [[Rcpp::export]]
 PyObjectRef py_dict_impl(const List& keys, const List& items, bool convert) {
+  GILScope _gil;
   PyObject* dict = PyDict_New();
   for (R_xlen_t i = 0; i<keys.length(); i++) {
     PyObjectPtr key(r_to_py(keys.at(i), convert));
@@ -1866,6 +3438,7 @@ PyObjectRef py_dict_impl(const List& keys, const List& items, bool convert) {
 
 // [[Rcpp::export]]
 SEXP py_dict_get_item(PyObjectRef dict, RObject key) {
+  GILScope _gil;
   PyObjectPtr pyKey(r_to_py(key, dict.convert()));
   PyObject* item = PyDict_GetItem(dict, pyKey);
   if (item != NULL) {
@@ -1879,6 +3452,7 @@ SEXP py_dict_get_item(PyObjectRef dict, RObject key) {
 
 // [[Rcpp::export]]
 void py_dict_set_item(PyObjectRef dict, RObject item, RObject value) {
+  GILScope _gil;
   PyObjectPtr pyItem(r_to_py(item, dict.convert()));
   PyObjectPtr pyValue(r_to_py(value, dict.convert()));
   PyDict_SetItem(dict, pyItem, pyValue);
@@ -1886,11 +3460,13 @@ void py_dict_set_item(PyObjectRef dict, RObject item, RObject value) {
 
 // [[Rcpp::export]]
 int py_dict_length(PyObjectRef dict) {
+  GILScope _gil;
   return PyDict_Size(dict);
 }
 
 // [[Rcpp::export]]
 CharacterVector py_dict_get_keys_as_str(PyObjectRef dict) {
+  GILScope _gil;
 
   // get the keys and check their length
   PyObjectPtr pyKeys(PyDict_Keys(dict));
@@ -1919,6 +3495,7 @@ CharacterVector py_dict_get_keys_as_str(PyObjectRef dict) {
 
 // [[Rcpp::export]]
 PyObjectRef py_tuple(const List& items, bool convert) {
+  GILScope _gil;
   PyObject* tuple = PyTuple_New(items.length());
   for (R_xlen_t i = 0; i<items.length(); i++) {
     PyObject* item = r_to_py(items.at(i), convert);
@@ -1932,12 +3509,14 @@ PyObjectRef py_tuple(const List& items, bool convert) {
 
 // [[Rcpp::export]]
 int py_tuple_length(PyObjectRef tuple) {
+  GILScope _gil;
   return PyTuple_Size(tuple);
 }
 
 
 // [[Rcpp::export]]
 PyObjectRef py_module_import(const std::string& module, bool convert) {
+  GILScope _gil;
   PyObject* pModule = py_import(module);
   if (pModule == NULL)
     stop(py_fetch_error());
@@ -1946,6 +3525,7 @@ PyObjectRef py_module_import(const std::string& module, bool convert) {
 
 // [[Rcpp::export]]
 void py_module_proxy_import(PyObjectRef proxy) {
+  GILScope _gil;
   if (proxy.exists("module")) {
     Rcpp::RObject r_module = proxy.getFromEnvironment("module");
     std::string module = as<std::string>(r_module);
@@ -1963,6 +3543,7 @@ void py_module_proxy_import(PyObjectRef proxy) {
 
 // [[Rcpp::export]]
 CharacterVector py_list_submodules(const std::string& module) {
+  GILScope _gil;
 
   std::vector<std::string> modules;
 
@@ -1986,11 +3567,40 @@ CharacterVector py_list_submodules(const std::string& module) {
 
 // Traverse a Python iterator or generator
 
+// the most items reserved up front for an iteration (iterables can report
+// any length, e.g. itertools.repeat(0, 10**15), so beyond this the vectors
+// just grow as required)
+const Py_ssize_t kMaxReservedItems = 1 << 16;
+
+// get the expected number of items in an iterable (or 0 if unknown), for
+// reserving space: capped at kMaxReservedItems
+Py_ssize_t py_length_hint(PyObject* x) {
+  if (PyObject_LengthHint == NULL)
+    return 0;
+  Py_ssize_t hint = PyObject_LengthHint(x, 0);
+  if (hint < 0) {
+    PyErr_Clear();
+    return 0;
+  }
+  return hint < kMaxReservedItems ? hint : kMaxReservedItems;
+}
+
+// call an R callback on behalf of Python without holding the GIL (R code
+// which re-enters Python will acquire it again), so that Python threads can
+// make progress while R is running
+SEXP call_r_function_unlocked(Function& f, SEXP arg) {
+  RObject protectedArg(arg);
+  GILUnlocker unlocker;
+  return f(protectedArg);
+}
+
 // [[Rcpp::export]]
 List py_iterate(PyObjectRef x, Function f) {
+  GILScope _gil;
 
   // List to return
   std::vector<RObject> list;
+  list.reserve(py_length_hint(x));
 
   // get the iterator
   PyObjectPtr iterator(PyObject_GetIter(x));
@@ -2013,7 +3623,131 @@ List py_iterate(PyObjectRef x, Function f) {
 
     // call the function
     SEXP param = x.convert() ? py_to_r(item, x.convert()) : py_ref(item, false);
-    list.push_back(f(param));
+    list.push_back(call_r_function_unlocked(f, param));
+  }
+
+  // return the list
+  List rList(list.size());
+  for (size_t i = 0; i<list.size(); i++)
+    rList[i] = list[i];
+  return rList;
+}
+
+// check whether a set of items are NumPy arrays with the same shape and type
+bool is_stackable_arrays(const std::vector<PyObject*>& items) {
+
+  if (items.empty() || !isPyArray(items[0]))
+    return false;
+
+  PyArrayObject* first = (PyArrayObject*) items[0];
+  int nd = PyArray_NDIM(first);
+  for (std::size_t i = 1; i<items.size(); i++) {
+    if (!isPyArray(items[i]))
+      return false;
+    PyArrayObject* array = (PyArrayObject*) items[i];
+    if (PyArray_TYPE(array) != PyArray_TYPE(first) || PyArray_NDIM(array) != nd)
+      return false;
+    for (int d = 0; d<nd; d++) {
+      if (PyArray_DIMS(array)[d] != PyArray_DIMS(first)[d])
+        return false;
+    }
+  }
+
+  return true;
+}
+
+// convert a chunk of items yielded by an iterator (we take ownership of the
+// items). homogeneous scalars become a vector, arrays with the same shape are
+// stacked into a single array (whose first dimension indexes the items) and
+// anything else becomes a list.
+SEXP py_iterate_convert_chunk(std::vector<PyObject*>& items, bool convert) {
+
+  // move the items into a Python list (which steals the references)
+  PyObjectPtr chunk(PyList_New(items.size()));
+  for (std::size_t i = 0; i<items.size(); i++)
+    PyList_SetItem(chunk, i, items[i]);
+
+  bool stackable = convert && is_stackable_arrays(items);
+  items.clear();
+
+  // return python objects if conversion wasn't requested
+  if (!convert) {
+    Py_ssize_t len = PyList_Size(chunk);
+    List list(len);
+    for (Py_ssize_t i = 0; i<len; i++) {
+      PyObject* item = PyList_GetItem(chunk, i);
+      Py_IncRef(item);
+      list[i] = py_ref(item, false);
+    }
+    return list;
+  }
+
+  // stack arrays
+  if (stackable) {
+    PyObjectPtr numpy(py_import("numpy"));
+    if (numpy.is_null())
+      stop(py_fetch_error());
+    PyObjectPtr stack(PyObject_GetAttrString(numpy, "stack"));
+    if (stack.is_null())
+      stop(py_fetch_error());
+    PyObjectPtr stacked(PyObject_CallFunctionObjArgs(stack, chunk.get(), NULL));
+    if (stacked.is_null())
+      stop(py_fetch_error());
+    return py_to_r(stacked, convert);
+  }
+
+  // scalars and other items go through list conversion
+  return py_to_r(chunk, convert);
+}
+
+// [[Rcpp::export]]
+List py_iterate_chunked(PyObjectRef x, Function f, int chunk_size) {
+  GILScope _gil;
+
+  // results of calling f on each chunk
+  std::vector<RObject> list;
+  Py_ssize_t hint = py_length_hint(x);
+  list.reserve(hint / chunk_size + 1);
+
+  // get the iterator
+  PyObjectPtr iterator(PyObject_GetIter(x));
+  if (iterator.is_null())
+    stop(py_fetch_error());
+
+  // items in the current chunk (owned references)
+  std::vector<PyObject*> items;
+  Py_ssize_t reserve = chunk_size < kMaxReservedItems ? chunk_size : kMaxReservedItems;
+  items.reserve(hint > 0 && hint < reserve ? hint : reserve);
+
+  try {
+
+    while (true) {
+
+      // check next item
+      PyObject* item = PyIter_Next(iterator);
+      if (item == NULL) {
+        // null return means either iteration is done or
+        // that there is an error
+        if (PyErr_Occurred())
+          stop(py_fetch_error());
+        else
+          break;
+      }
+
+      // process the chunk once it's full
+      items.push_back(item);
+      if (items.size() == (std::size_t) chunk_size)
+        list.push_back(call_r_function_unlocked(f, py_iterate_convert_chunk(items, x.convert())));
+    }
+
+    // process any remaining items
+    if (!items.empty())
+      list.push_back(call_r_function_unlocked(f, py_iterate_convert_chunk(items, x.convert())));
+
+  } catch(...) {
+    for (std::size_t i = 0; i<items.size(); i++)
+      Py_DecRef(items[i]);
+    throw;
   }
 
   // return the list
@@ -2025,6 +3759,7 @@ List py_iterate(PyObjectRef x, Function f) {
 
 // [[Rcpp::export]]
 SEXP py_iter_next(PyObjectRef iterator, RObject completed) {
+  GILScope _gil;
 
   PyObjectPtr item(PyIter_Next(iterator));
   if (item.is_null()) {
@@ -2046,12 +3781,204 @@ SEXP py_iter_next(PyObjectRef iterator, RObject completed) {
 }
 
 
+// least recently used cache of compiled code objects, keyed on the code and
+// the mode it was compiled in (Py_eval_input or Py_file_input), so that code
+// which is evaluated repeatedly only needs to be parsed once. large blocks of
+// code (e.g. whole scripts) are compiled without being cached.
+class CodeCache {
+
+public:
+
+  CodeCache() {}
+
+  // returns a new reference, or NULL (with a Python error set) if the code
+  // couldn't be compiled
+  PyObject* compile(const std::string& code, int mode) {
+
+    if (code.size() > kMaxCodeSize)
+      return compile_code(code, mode);
+
+    Key key(mode, code);
+    Index::iterator it = index_.find(key);
+    if (it != index_.end()) {
+      // move to the front (most recently used)
+      entries_.splice(entries_.begin(), entries_, it->second);
+      Py_IncRef(it->second->second);
+      return it->second->second;
+    }
+
+    PyObject* compiled = compile_code(code, mode);
+    if (compiled == NULL)
+      return NULL;
+
+    // evict the least recently used entry if we're full
+    if (entries_.size() >= kMaxEntries) {
+      Entry& last = entries_.back();
+      Py_DecRef(last.second);
+      index_.erase(last.first);
+      entries_.pop_back();
+    }
+
+    Py_IncRef(compiled);
+    entries_.push_front(Entry(key, compiled));
+    index_[key] = entries_.begin();
+    return compiled;
+  }
+
+private:
+
+  // same file names as used by py_eval() and PyRun_String()
+  static PyObject* compile_code(const std::string& code, int mode) {
+    const char* filename = mode == Py_eval_input ? "reticulate_eval" : "<string>";
+    return Py_CompileString(code.c_str(), filename, mode);
+  }
+
+  typedef std::pair<int, std::string> Key;
+  typedef std::pair<Key, PyObject*> Entry;
+  typedef std::list<Entry> Entries;
+  typedef std::map<Key, Entries::iterator> Index;
+
+  static const std::size_t kMaxEntries = 256;
+  static const std::size_t kMaxCodeSize = 64 * 1024;
+
+  Entries entries_;
+  Index index_;
+
+  CodeCache(const CodeCache&);
+  CodeCache& operator=(const CodeCache&);
+};
+
+CodeCache s_code_cache;
+
+// compiled code for source files run via py_run_file(), keyed on the path of
+// the file and validated against its modification time and size. on a miss
+// the code is loaded from the __pycache__ directory beside the file, or
+// compiled (and, with the reticulate.write_bytecode option set, written
+// there), via rpytools.bytecode.
+class FileCodeCache {
+
+public:
+
+  FileCodeCache() {}
+
+  // returns a new reference, or NULL with a Python error set. 'file' is the
+  // path as supplied by the user (for error messages).
+  PyObject* compile(const std::string& path, const std::string& file) {
+
+    struct stat info;
+    if (::stat(path.c_str(), &info) != 0)
+      stop("Unable to open file '%s' (does it exist?)", file);
+
+    long mtime = (long) info.st_mtime;
+    long size = (long) info.st_size;
+
+    Entries::iterator it = entries_.find(path);
+    if (it != entries_.end()) {
+      if (it->second.mtime == mtime && it->second.size == size) {
+        Py_IncRef(it->second.code);
+        return it->second.code;
+      }
+      Py_DecRef(it->second.code);
+      entries_.erase(it);
+    }
+
+    PyObjectPtr module(py_import("rpytools.bytecode"));
+    if (module.is_null())
+      return NULL;
+
+    PyObjectPtr pyPath(as_python_str(path));
+    PyObjectPtr pyMtime(PyInt_FromLong(mtime));
+    PyObjectPtr pySize(PyInt_FromLong(size));
+
+    // check for up to date bytecode
+    PyObjectPtr loadCached(PyObject_GetAttrString(module, "load_cached"));
+    if (loadCached.is_null())
+      return NULL;
+    PyObjectPtr code(PyObject_CallFunctionObjArgs(
+      loadCached, pyPath.get(), pyMtime.get(), pySize.get(), NULL));
+    if (code.is_null())
+      return NULL;
+
+    // otherwise read and compile the source
+    if (code.get() == Py_None) {
+
+      std::string source;
+      if (!read_source_file(path, &source))
+        stop("Error occurred while reading file '%s'", file);
+
+      PyObjectPtr pySource(is_python3() ?
+        PyBytes_FromStringAndSize(source.data(), source.size()) :
+        PyString_FromStringAndSize(source.data(), source.size()));
+      if (pySource.is_null())
+        return NULL;
+
+      PyObject* write = option_is_true("reticulate.write_bytecode") ? Py_True : Py_False;
+      PyObjectPtr compileSource(PyObject_GetAttrString(module, "compile_source"));
+      if (compileSource.is_null())
+        return NULL;
+      code.assign(PyObject_CallFunctionObjArgs(
+        compileSource, pyPath.get(), pySource.get(), pyMtime.get(), pySize.get(), write, NULL));
+      if (code.is_null())
+        return NULL;
+    }
+
+    if (entries_.size() >= kMaxEntries) {
+      for (Entries::iterator it = entries_.begin(); it != entries_.end(); ++it)
+        Py_DecRef(it->second.code);
+      entries_.clear();
+    }
+
+    Entry entry;
+    entry.mtime = mtime;
+    entry.size = size;
+    entry.code = code.get();
+    Py_IncRef(entry.code);
+    entries_[path] = entry;
+
+    return code.detach();
+  }
+
+private:
+
+  struct Entry {
+    long mtime;
+    long size;
+    PyObject* code;
+  };
+
+  typedef std::map<std::string, Entry> Entries;
+
+  static const std::size_t kMaxEntries = 64;
+
+  Entries entries_;
+
+  FileCodeCache(const FileCodeCache&);
+  FileCodeCache& operator=(const FileCodeCache&);
+};
+
+FileCodeCache s_file_code_cache;
+
+SEXP py_run_code(PyObject* code, bool local, bool convert);
+
 // [[Rcpp::export]]
 SEXP py_run_string_impl(const std::string& code,
                         bool local = false,
                         bool convert = true)
 {
-  // run string
+  GILScope _gil;
+  profiler::Boundary _boundary;
+
+  PyObjectPtr compiledCode(s_code_cache.compile(code, Py_file_input));
+  if (compiledCode.is_null())
+    stop(py_fetch_error());
+
+  return py_run_code(compiledCode, local, convert);
+}
+
+// run compiled code within the main module (or, if 'local' is true, with a
+// new dictionary of locals), returning the dictionary
+SEXP py_run_code(PyObject* code, bool local, bool convert) {
+
   PyObject* main = PyImport_AddModule("__main__");
   PyObject* main_dict = PyModule_GetDict(main);
   PyObject* local_dict = NULL;
@@ -2062,8 +3989,7 @@ SEXP py_run_string_impl(const std::string& code,
   } else {
     local_dict = main_dict;
   }
-  PyObjectPtr res(PyRun_StringFlags(code.c_str(), Py_file_input,
-                                    main_dict, local_dict, NULL));
+  PyObjectPtr res(PyEval_EvalCode(code, main_dict, local_dict));
   if (res.is_null())
     stop(py_fetch_error());
 
@@ -2078,31 +4004,29 @@ SEXP py_run_file_impl(const std::string& file,
                       bool local = false,
                       bool convert = true)
 {
+  GILScope _gil;
+  profiler::Boundary _boundary;
+
   // expand path
-  Function pathExpand("path.expand");
-  std::string expanded = as<std::string>(pathExpand(file));
+  std::string expanded(R_ExpandFileName(file.c_str()));
 
-  // read file
-  std::ifstream ifs(expanded.c_str());
-  if (!ifs)
-    stop("Unable to open file '%s' (does it exist?)", file);
-  std::string code((std::istreambuf_iterator<char>(ifs)),
-                   (std::istreambuf_iterator<char>()));
-  if (ifs.fail())
-    stop("Error occurred while reading file '%s'", file);
+  PyObjectPtr code(s_file_code_cache.compile(expanded, file));
+  if (code.is_null())
+    stop(py_fetch_error());
 
-  // execute
-  return py_run_string_impl(code, local, convert);
+  return py_run_code(code, local, convert);
 }
 
 // [[Rcpp::export]]
 SEXP py_eval_impl(const std::string& code, bool convert = true) {
+  GILScope _gil;
+  profiler::Boundary _boundary;
 
   // R object to return
   RObject rObject;
 
   // compile the code
-  PyObjectPtr compiledCode(Py_CompileString(code.c_str(), "reticulate_eval", Py_eval_input));
+  PyObjectPtr compiledCode(s_code_cache.compile(code, Py_eval_input));
   if (compiledCode.is_null())
     stop(py_fetch_error());
 
@@ -2122,3 +4046,206 @@ SEXP py_eval_impl(const std::string& code, bool convert = true) {
    rObject = py_ref(res, convert);
  return rObject;
 }
+
+// name of a code object in profiles, e.g. 'f (script.py:12)'
+std::string profile_code_name(PyObject* code) {
+
+  std::ostringstream ostr;
+  PyObjectPtr name(PyObject_GetAttrString(code, "co_name"));
+  PyObjectPtr filename(PyObject_GetAttrString(code, "co_filename"));
+  PyObjectPtr line(PyObject_GetAttrString(code, "co_firstlineno"));
+  if (name.is_null() || filename.is_null() || line.is_null()) {
+    PyErr_Clear();
+    return "<unknown>";
+  }
+
+  ostr << as_std_string(name) << " (" << as_std_string(filename) << ":" << PyInt_AsLong(line) << ")";
+  return ostr.str();
+}
+
+// [[Rcpp::export]]
+void py_profile_start_impl(int interval_ms, int max_samples) {
+  GILScope _gil;
+  std::string err;
+  if (!profiler::start(interval_ms, max_samples, is_python3(), s_profile_calls_fn, &err))
+    stop(err);
+}
+
+// stop the profiler and collect its samples
+void profile_collect(std::vector<std::string>* pStacks,
+                     std::vector<double>* pCounts,
+                     uint64_t* pDropped) {
+
+  GILScope _gil;
+
+  // stop sampling with the GIL released (the sampling thread may be waiting
+  // for it, and it may be held even outside of GILScope when embedded)
+  {
+    GILUnlocker _unlock;
+    profiler::stop();
+  }
+
+  profiler::collapse(profile_code_name, pStacks, pCounts, pDropped);
+}
+
+// write the profile started via RETICULATE_DUMP_STACK_TRACE as R exits: to
+// the file named by RETICULATE_DUMP_STACK_TRACE_FILE, or otherwise to stderr
+void profile_write_at_exit(SEXP) {
+
+  if (!s_profile_at_exit || !profiler::active())
+    return;
+  s_profile_at_exit = false;
+
+  std::vector<std::string> stacks;
+  std::vector<double> counts;
+  uint64_t dropped = 0;
+  profile_collect(&stacks, &counts, &dropped);
+
+  const char* file = ::getenv("RETICULATE_DUMP_STACK_TRACE_FILE");
+  if (file != NULL && *file != '\0') {
+    std::ofstream ostr(file);
+    for (std::size_t i = 0; i < stacks.size(); i++)
+      ostr << stacks[i] << " " << counts[i] << std::endl;
+  } else {
+    for (std::size_t i = 0; i < stacks.size(); i++)
+      REprintf("%s %.0f\n", stacks[i].c_str(), counts[i]);
+  }
+}
+
+// [[Rcpp::export]]
+List py_profile_stop_impl() {
+
+  s_profile_at_exit = false;
+
+  std::vector<std::string> stacks;
+  std::vector<double> counts;
+  uint64_t dropped = 0;
+  profile_collect(&stacks, &counts, &dropped);
+
+  return List::create(
+    _["stack"] = stacks,
+    _["samples"] = counts,
+    _["dropped"] = (double) dropped
+  );
+}
+
+List r_latency_stats(const stats::Latency& latency) {
+  NumericVector buckets(stats::kLatencyBuckets);
+  CharacterVector names(stats::kLatencyBuckets);
+  for (int i = 0; i < stats::kLatencyBuckets; i++) {
+    buckets[i] = latency.buckets[i];
+    names[i] = latency_bucket_name(i);
+  }
+  buckets.names() = names;
+  return List::create(
+    _["count"] = (double) latency.count,
+    _["total_seconds"] = latency.totalNs / 1E9,
+    _["latency"] = buckets
+  );
+}
+
+// [[Rcpp::export]]
+List py_stats_impl(bool reset = false) {
+
+  GILScope _gil;
+
+  stats::Snapshot snapshot = stats::snapshot();
+  if (reset)
+    stats::reset();
+
+  NumericVector pyToR(snapshot.pyToR.size());
+  CharacterVector pyToRNames(snapshot.pyToR.size());
+  for (std::size_t i = 0; i < snapshot.pyToR.size(); i++) {
+    pyToR[i] = snapshot.pyToR[i].second;
+    pyToRNames[i] = snapshot.pyToR[i].first;
+  }
+  pyToR.names() = pyToRNames;
+
+  NumericVector rToPy(snapshot.rToPy.size());
+  CharacterVector rToPyNames(snapshot.rToPy.size());
+  for (std::size_t i = 0; i < snapshot.rToPy.size(); i++) {
+    rToPy[i] = snapshot.rToPy[i].second;
+    rToPyNames[i] = Rf_type2char(snapshot.rToPy[i].first);
+  }
+  rToPy.names() = rToPyNames;
+
+  List tasks = List::create(
+    _["scheduled"] = (double) snapshot.tasksScheduled,
+    _["completed"] = (double) snapshot.tasksCompleted,
+    _["max_pending"] = (double) snapshot.taskQueueMaxDepth
+  );
+
+  return List::create(
+    _["py_to_r"] = pyToR,
+    _["r_to_py"] = rToPy,
+    _["bytes_to_r"] = (double) snapshot.bytesToR,
+    _["bytes_to_py"] = (double) snapshot.bytesToPy,
+    _["python_calls"] = r_latency_stats(snapshot.pythonCalls),
+    _["r_callbacks"] = r_latency_stats(snapshot.rCallbacks),
+    _["main_thread_tasks"] = tasks,
+    _["event_polls"] = (double) snapshot.pollTicks
+  );
+}
+
+// [[Rcpp::export]]
+PyObjectRef py_compile_impl(const std::string& code, bool eval) {
+  GILScope _gil;
+
+  PyObject* compiledCode = s_code_cache.compile(code, eval ? Py_eval_input : Py_file_input);
+  if (compiledCode == NULL)
+    stop(py_fetch_error());
+
+  return py_ref(compiledCode, false);
+}
+
+// [[Rcpp::export]]
+SEXP py_eval_code_impl(PyObjectRef code,
+                       RObject globals,
+                       RObject locals,
+                       bool convert = true)
+{
+  GILScope _gil;
+  profiler::Boundary _boundary;
+
+  if (std::strcmp(Py_TYPE(code.get())->tp_name, "code") != 0)
+    stop("'code' must be a compiled code object (see py_compile())");
+
+  // use the dictionary of the main module by default
+  PyObject* mainDict = PyModule_GetDict(PyImport_AddModule("__main__"));
+  PyObjectPtr globalsDict;
+  if (globals.isNULL()) {
+    globalsDict.assign(mainDict);
+    Py_IncRef(globalsDict);
+  } else {
+    globalsDict.assign(r_to_py(globals, false));
+    if (!PyDict_Check(globalsDict))
+      stop("'globals' must be a dictionary");
+
+    // provide access to builtins (as exec() and eval() do)
+    PyObjectPtr builtinsName(py_attr_name("__builtins__"));
+    if (PyDict_Contains(globalsDict, builtinsName) == 0) {
+      PyObject* builtins = PyDict_GetItem(mainDict, builtinsName);
+      if (builtins != NULL && PyDict_SetItem(globalsDict, builtinsName, builtins) != 0)
+        stop(py_fetch_error());
+    }
+  }
+
+  // evaluate with the globals as locals unless otherwise specified
+  PyObjectPtr localsDict;
+  if (locals.isNULL()) {
+    localsDict.assign(globalsDict);
+    Py_IncRef(localsDict);
+  } else {
+    localsDict.assign(r_to_py(locals, false));
+  }
+
+  PyObjectPtr res(PyEval_EvalCode(code, globalsDict, localsDict));
+  if (res.is_null())
+    stop(py_fetch_error());
+
+  // return (convert to R if requested)
+  if (convert)
+    return py_to_r(res, convert);
+  else
+    return py_ref(res.detach(), convert);
+}
@@ -6,12 +6,48 @@ using namespace libpython;
 
 #include <Rcpp.h>
 
+// (the reference is released later, in a batch with others; see
+// decref_deferred)
 inline void python_object_finalize(SEXP object) {
   PyObject* pyObject = (PyObject*)R_ExternalPtrAddr(object);
-  if (pyObject != NULL)
-    Py_DecRef(pyObject);
+  if (pyObject != NULL && Py_IsInitialized != NULL && Py_IsInitialized())
+    decref_deferred(pyObject);
 }
 
+// symbols for the bindings of object references (installed once, so that
+// accessing them doesn't require a lookup in R's symbol table)
+inline SEXP pyobj_symbol() {
+  static SEXP symbol = Rf_install("pyobj");
+  return symbol;
+}
+
+inline SEXP convert_symbol() {
+  static SEXP symbol = Rf_install("convert");
+  return symbol;
+}
+
+// allocate an empty environment (whose parent is the empty environment)
+// directly rather than by calling new.env()
+inline SEXP new_empty_env(bool hash) {
+#if R_VERSION >= R_Version(4, 1, 0)
+  return R_NewEnv(R_EmptyEnv, hash ? TRUE : FALSE, hash ? 29 : 0);
+#else
+  SEXP env = Rf_allocSExp(ENVSXP);
+  SET_ENCLOS(env, R_EmptyEnv);
+  return env;
+#endif
+}
+
+// a reference to a Python object: an environment holding the external
+// pointer ('pyobj') and the convert flag ('convert'). the handle remains an
+// environment (rather than e.g. a bare external pointer with an environment
+// created on demand) as the R side depends on that: module proxies are
+// environments which become module references in place once the module is
+// imported, py_maybe_convert() and disable_conversion_scope() change the
+// convert flag with assign(), and as.environment() is used to reach the
+// reference behind objects wrapped as R functions. the cost per handle is
+// instead kept down by allocating the environment directly (new_empty_env)
+// and binding via pre-installed symbols.
 class PyObjectRef : public Rcpp::Environment {
 
 public:
@@ -19,14 +55,14 @@ public:
   explicit PyObjectRef(SEXP object) : Rcpp::Environment(object) {}
 
   explicit PyObjectRef(PyObject* object, bool convert) :
-      Rcpp::Environment(Rcpp::Environment::empty_env().new_child(false)) {
+      Rcpp::Environment(new_empty_env(false)) {
     set(object);
-    assign("convert", convert);
+    Rf_defineVar(convert_symbol(), Rf_ScalarLogical(convert), get__());
   }
 
   PyObject* get() const {
-    SEXP pyObject = getFromEnvironment("pyobj");
-    if (pyObject != R_NilValue) {
+    SEXP pyObject = xptr();
+    if (TYPEOF(pyObject) == EXTPTRSXP) {
       PyObject* obj = (PyObject*)R_ExternalPtrAddr(pyObject);
       if (obj != NULL)
         return obj;
@@ -39,10 +75,8 @@ public:
   }
 
   bool is_null_xptr() const {
-    SEXP pyObject = getFromEnvironment("pyobj");
-    if (pyObject == NULL)
-      return true;
-    else if (pyObject == R_NilValue)
+    SEXP pyObject = xptr();
+    if (TYPEOF(pyObject) != EXTPTRSXP)
       return true;
     else if ((PyObject*)R_ExternalPtrAddr(pyObject) == NULL)
       return true;
@@ -51,24 +85,31 @@ public:
   }
 
   void set(PyObject* object) {
-    Rcpp::RObject xptr = R_MakeExternalPtr((void*) object, R_NilValue, R_NilValue);
+    SEXP xptr = PROTECT(R_MakeExternalPtr((void*) object, R_NilValue, R_NilValue));
     R_RegisterCFinalizer(xptr, python_object_finalize);
-    assign("pyobj", xptr);
+    Rf_defineVar(pyobj_symbol(), xptr, get__());
+    UNPROTECT(1);
   }
 
   bool convert() const {
-    Rcpp::RObject pyObject = getFromEnvironment("convert");
-    if (pyObject == R_NilValue)
+    SEXP value = Rf_findVarInFrame(get__(), convert_symbol());
+    if (value == R_UnboundValue || value == R_NilValue)
       return true;
     else
-      return Rcpp::as<bool>(pyObject);
+      return Rf_asLogical(value) != 0;
   }
 
-
   SEXP getFromEnvironment(const std::string& name) const {
     return Rcpp::Environment::get(name);
   }
 
+private:
+
+  // (R_UnboundValue if the binding doesn't exist)
+  SEXP xptr() const {
+    return Rf_findVarInFrame(get__(), pyobj_symbol());
+  }
+
 };
 
 #endif // __RETICULATE_TYPES__
@@ -0,0 +1,196 @@
+
+#include "stats.h"
+
+#ifdef _WIN32
+# include <windows.h>
+#else
+# include <time.h>
+#endif
+
+#include <cstring>
+
+using namespace libpython;
+
+namespace stats {
+
+namespace {
+
+// conversions from Python, counted by type in a small open addressing table
+// keyed on the address of the type object, which holds a reference to each
+// type (types beyond its capacity are counted together)
+enum { kTypeSlots = 128 };
+
+struct TypeCount {
+  PyObject* type;
+  std::string name;
+  uint64_t count;
+};
+
+TypeCount s_pyToR[kTypeSlots];
+uint64_t s_pyToROther = 0;
+
+// conversions from R, counted by SEXP type
+enum { kSexpTypes = 32 };
+uint64_t s_rToPy[kSexpTypes];
+
+uint64_t s_bytesToR = 0;
+uint64_t s_bytesToPy = 0;
+
+Latency s_pythonCalls;
+Latency s_rCallbacks;
+
+// updated from other threads
+volatile long s_tasksScheduled = 0;
+volatile long s_tasksCompleted = 0;
+volatile long s_taskQueueMaxDepth = 0;
+volatile long s_pollTicks = 0;
+
+void record_latency(Latency* latency, uint64_t ns) {
+  latency->count++;
+  latency->totalNs += ns;
+  uint64_t us = ns / 1000;
+  int bucket = 0;
+  while (bucket < kLatencyBuckets - 1 && us >= ((uint64_t) 1 << bucket))
+    bucket++;
+  latency->buckets[bucket]++;
+}
+
+} // anonymous namespace
+
+uint64_t now() {
+#ifdef _WIN32
+  static LARGE_INTEGER frequency;
+  if (frequency.QuadPart == 0)
+    ::QueryPerformanceFrequency(&frequency);
+  LARGE_INTEGER counter;
+  ::QueryPerformanceCounter(&counter);
+  return (uint64_t) ((double) counter.QuadPart * 1E9 / (double) frequency.QuadPart);
+#else
+  struct timespec ts;
+  ::clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+void count_py_to_r(PyObject* type, const char* typeName) {
+
+  std::size_t value = (std::size_t) type;
+  std::size_t slot = ((value >> 4) ^ (value >> 12)) & (kTypeSlots - 1);
+
+  for (int probe = 0; probe < kTypeSlots; probe++) {
+    TypeCount& entry = s_pyToR[(slot + probe) & (kTypeSlots - 1)];
+    if (entry.type == type) {
+      entry.count++;
+      return;
+    } else if (entry.type == NULL) {
+      Py_IncRef(type);
+      entry.type = type;
+      entry.name = typeName;
+      entry.count = 1;
+      return;
+    }
+  }
+
+  s_pyToROther++;
+}
+
+void count_r_to_py(int sexpType) {
+  if (sexpType >= 0 && sexpType < kSexpTypes)
+    s_rToPy[sexpType]++;
+}
+
+void count_bytes_to_r(uint64_t bytes) {
+  s_bytesToR += bytes;
+}
+
+void count_bytes_to_py(uint64_t bytes) {
+  s_bytesToPy += bytes;
+}
+
+void record_python_call(uint64_t ns) {
+  record_latency(&s_pythonCalls, ns);
+}
+
+void record_r_callback(uint64_t ns) {
+  record_latency(&s_rCallbacks, ns);
+}
+
+void task_scheduled() {
+  long scheduled = __sync_add_and_fetch(&s_tasksScheduled, 1);
+  long depth = scheduled - s_tasksCompleted;
+  long maxDepth;
+  while (depth > (maxDepth = s_taskQueueMaxDepth)) {
+    if (__sync_bool_compare_and_swap(&s_taskQueueMaxDepth, maxDepth, depth))
+      break;
+  }
+}
+
+void task_completed() {
+  __sync_add_and_fetch(&s_tasksCompleted, 1);
+}
+
+void poll_tick() {
+  __sync_add_and_fetch(&s_pollTicks, 1);
+}
+
+Snapshot snapshot() {
+
+  Snapshot snapshot;
+
+  for (int i = 0; i < kTypeSlots; i++) {
+    if (s_pyToR[i].type != NULL)
+      snapshot.pyToR.push_back(std::make_pair(s_pyToR[i].name, s_pyToR[i].count));
+  }
+  if (s_pyToROther > 0)
+    snapshot.pyToR.push_back(std::make_pair(std::string("(other)"), s_pyToROther));
+
+  for (int i = 0; i < kSexpTypes; i++) {
+    if (s_rToPy[i] > 0)
+      snapshot.rToPy.push_back(std::make_pair(i, s_rToPy[i]));
+  }
+
+  snapshot.bytesToR = s_bytesToR;
+  snapshot.bytesToPy = s_bytesToPy;
+  snapshot.pythonCalls = s_pythonCalls;
+  snapshot.rCallbacks = s_rCallbacks;
+  snapshot.tasksScheduled = s_tasksScheduled;
+  snapshot.tasksCompleted = s_tasksCompleted;
+  snapshot.taskQueueMaxDepth = s_taskQueueMaxDepth;
+  snapshot.pollTicks = s_pollTicks;
+
+  return snapshot;
+}
+
+void reset() {
+
+  bool initialized = Py_IsInitialized != NULL && Py_IsInitialized();
+  for (int i = 0; i < kTypeSlots; i++) {
+    if (s_pyToR[i].type != NULL && initialized)
+      Py_DecRef(s_pyToR[i].type);
+    s_pyToR[i].type = NULL;
+    s_pyToR[i].name.clear();
+    s_pyToR[i].count = 0;
+  }
+  s_pyToROther = 0;
+
+  std::memset(s_rToPy, 0, sizeof(s_rToPy));
+  s_bytesToR = 0;
+  s_bytesToPy = 0;
+  std::memset(&s_pythonCalls, 0, sizeof(s_pythonCalls));
+  std::memset(&s_rCallbacks, 0, sizeof(s_rCallbacks));
+
+  // tasks which are still queued remain counted as scheduled
+  long pending = s_tasksScheduled - s_tasksCompleted;
+  __sync_lock_test_and_set(&s_tasksScheduled, pending > 0 ? pending : 0);
+  __sync_lock_test_and_set(&s_tasksCompleted, 0);
+  __sync_lock_test_and_set(&s_taskQueueMaxDepth, pending > 0 ? pending : 0);
+  __sync_lock_test_and_set(&s_pollTicks, 0);
+}
+
+uint64_t bucket_limit_us(int bucket) {
+  if (bucket < 0 || bucket >= kLatencyBuckets - 1)
+    return 0;
+  return (uint64_t) 1 << bucket;
+}
+
+} // namespace stats
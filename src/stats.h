@@ -0,0 +1,90 @@
+
+#ifndef __RETICULATE_STATS__
+#define __RETICULATE_STATS__
+
+#include "libpython.h"
+
+#include <stdint.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// Counters for the conversions and calls made between R and Python (reported
+// by py_stats() in R, and rpycall.stats() in Python). Conversions and calls
+// are counted on the main thread only, so those counters are not atomic; the
+// counters for the task queue and the event polling thread are updated
+// atomically as they are updated from other threads.
+
+namespace stats {
+
+// latency histogram with power of two buckets: the first bucket counts
+// latencies under 1 microsecond, the next under 2, and so on; the last bucket
+// counts everything else
+enum { kLatencyBuckets = 22 };
+
+struct Latency {
+  uint64_t count;
+  uint64_t totalNs;
+  uint64_t buckets[kLatencyBuckets];
+};
+
+// monotonic time in nanoseconds
+uint64_t now();
+
+// conversions (the type of Python objects is identified by its address: each
+// type counted is kept alive by a reference until the counters are reset, so
+// that its address can't be reused by another type)
+void count_py_to_r(libpython::PyObject* type, const char* typeName);
+void count_r_to_py(int sexpType);
+void count_bytes_to_r(uint64_t bytes);
+void count_bytes_to_py(uint64_t bytes);
+
+// calls into Python (from R), and callbacks into R (from Python)
+void record_python_call(uint64_t ns);
+void record_r_callback(uint64_t ns);
+
+// tasks queued to run on the main thread (from any thread)
+void task_scheduled();
+void task_completed();
+
+// polls by the event loop thread
+void poll_tick();
+
+// time a scope, recording it via 'record' (e.g. record_python_call)
+class Timer {
+public:
+  explicit Timer(void (*record)(uint64_t)) : record_(record), start_(now()) {}
+  ~Timer() {
+    record_(now() - start_);
+  }
+private:
+  Timer(const Timer&);
+  Timer& operator=(const Timer&);
+  void (*record_)(uint64_t);
+  uint64_t start_;
+};
+
+struct Snapshot {
+  std::vector<std::pair<std::string, uint64_t> > pyToR;
+  std::vector<std::pair<int, uint64_t> > rToPy;
+  uint64_t bytesToR;
+  uint64_t bytesToPy;
+  Latency pythonCalls;
+  Latency rCallbacks;
+  uint64_t tasksScheduled;
+  uint64_t tasksCompleted;
+  uint64_t taskQueueMaxDepth;
+  uint64_t pollTicks;
+};
+
+Snapshot snapshot();
+void reset(); // requires the GIL
+
+// upper bound (in microseconds) of a latency bucket (0 for the last bucket,
+// which has no upper bound)
+uint64_t bucket_limit_us(int bucket);
+
+} // namespace stats
+
+#endif // __RETICULATE_STATS__